@@ -1,7 +1,13 @@
 /********************************************************************************
   Provides interface for playing the game using the most recently generated rooms
+
+  Build: gcc -o kuskc.adventure kuskc.adventure.c kuskc.world.c kuskc.stats.c -lpthread
+  Add -DKUSKC_STATS to turn on --stats, see kuskc.stats.h
+  Add -DKUSKC_EMBEDDED to play the world in kuskc.embedded.h instead of the newest
+  rooms directory, make embedded builds kuskc.adventure.embedded this way
 *********************************************************************************/
 
+#define _GNU_SOURCE	// Needed for accept4
 #include <stdio.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -12,54 +18,666 @@
 #include <pthread.h>
 #include <stdlib.h>
 #include <time.h>
+#include <getopt.h>	// Needed for command line options
+#include <fcntl.h>
+#include <ctype.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>	// Needed for Unix domain sockets
+#include "kuskc.world.h"
+#include "kuskc.stats.h"
+#ifdef KUSKC_EMBEDDED
+#include "kuskc.embedded.h"	// World written by buildrooms -f source, see make embedded
+#endif
 
 // Global Variables
-int NUM_ROOMS = 7;
+int NUM_ROOMS = 7;	// Set to number of rooms read from text room files
 pthread_mutex_t my_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+// Long lived thread that keeps a formatted time ready, guarded by my_mutex
+struct TimeService
+{
+	pthread_t thread;
+	pthread_cond_t wake;                 // Signalled on file request or stop
+	char timeString[80];                 // Time formatted for the user
+	time_t formattedAt;                  // Second timeString was formatted for
+	bool writeFile;                      // Also write currentTime.txt on requests
+	bool fileRequested;                  // Game asked for currentTime.txt
+	bool running;
+};
+struct TimeService timeService = { .wake = PTHREAD_COND_INITIALIZER };
+
+#define EVENT_RING_SIZE 4096	// Events waiting for the writer thread, a power of two
+#define EVENT_BATCH_SIZE 65536	// Bytes of records the writer gathers per write
+#define EVENT_LINE_SIZE 160	// Longest JSONL record
+#define EVENT_IDLE_NS 10000000	// Writer looks at an empty ring every 10ms
+#define EVENT_FILE_MAGIC "KUSKCEVT"	// Start of --event-format binary files
+#define EVENT_FILE_VERSION 1
+
+// Kinds of gameplay event, in the order of eventNames
+enum EventType
+{
+	EVENT_START,                         // Game began in the START room
+	EVENT_MOVE,                          // Player moved, detail is the room left
+	EVENT_INVALID,                       // Input matched no connection
+	EVENT_TIME,
+	EVENT_HINT,
+	EVENT_END,                           // END was reached, detail is the steps taken
+	EVENT_QUIT,                          // Input ended or player hung up before END
+	EVENT_DROPPED                        // Written by the writer, detail events were lost
+};
+const char *eventNames[] = { "start", "move", "invalid", "time", "hint", "end", "quit", "dropped" };
+
+// One event, also the record --event-format binary writes after its header
+struct GameEvent
+{
+	uint64_t time;                       // Nanoseconds since the epoch
+	uint32_t session;                    // 0 for console games, server sessions count from 1
+	uint32_t room;                       // Room the player is in after the event
+	uint32_t detail;                     // See EventType
+	uint32_t type;
+};
+
+// Events go from the game thread to the writer thread without a lock. Only the game
+// writes head and dropped, only the writer writes tail, and each side's fields have a
+// cache line to themselves. A full ring drops the event, the player never waits.
+struct EventLog
+{
+	struct GameEvent events[EVENT_RING_SIZE];
+	uint64_t head __attribute__((aligned(64)));	// Next slot the game fills
+	uint64_t tailSeen;                   // Game's last look at tail, saves rereading it
+	uint64_t dropped;                    // Events lost to a full ring
+	uint64_t tail __attribute__((aligned(64)));	// Next slot the writer reads
+	uint64_t droppedWritten;             // Drops already recorded in the file
+	int fd;
+	bool binary;
+	bool failed;                         // Write failed, the rest is read and thrown away
+	bool running;
+	bool enabled;                        // Only the game thread reads it
+	pthread_t thread;
+};
+struct EventLog eventLog;
+
+#define BATCH_BUFFER_SIZE (1 << 20)	// Bytes read from batch input per read call
+
+// Kinds of token returned by nextBatchToken
+enum BatchToken
+{
+	TOKEN_WORD,
+	TOKEN_NEWLINE,
+	TOKEN_EOF
+};
+
+// Batch input read in large blocks and split into words in place
+struct BatchInput
+{
+	int fd;
+	char *buffer;                        // BATCH_BUFFER_SIZE + 1 bytes, room for a terminator
+	size_t next;                         // First byte not yet tokenized
+	size_t end;                          // One past last byte read
+	bool eof;
+	bool pendingNewline;                 // Word ended at a newline, report it next
+};
+
+#define WALK_BATCH 256	// Walkers one thread moves a step at a time in turn
+#define WALK_EXACT_STEPS 1024	// Walk lengths below this are counted exactly
+#define WALK_SUB_BUCKETS 64	// Longer walks are split 64 ways per power of two
+#define WALK_BUCKETS (WALK_EXACT_STEPS + 54 * WALK_SUB_BUCKETS)	// Enough for any uint64_t
+#define WALK_MAX_THREADS 64
+
+// Random walks from START to END run by one thread, and what they added up to
+struct WalkJob
+{
+	const struct World *world;
+	uint64_t numWalks;
+	uint64_t random;                     // xorshift64* state, one stream per thread
+	uint64_t totalSteps;
+	uint64_t shortestWalk, longestWalk;
+	uint64_t histogram[WALK_BUCKETS];    // Walks by number of steps, see walkBucket
+};
+
+#define PATH_CHUNK_STEPS 1024	// Steps held by one path log chunk, 4KB
+
+// Block of steps in a path log, never moved once allocated
+struct PathChunk
+{
+	struct PathChunk *next;
+	uint32_t rooms[PATH_CHUNK_STEPS];
+};
+
+// Rooms visited in order, 4 bytes a step with no ceiling. Grows a chunk at a time so
+// steps are never copied, and keeps its chunks when cleared for the next session.
+struct PathLog
+{
+	struct PathChunk *first;
+	struct PathChunk *last;              // Chunk being filled
+	uint32_t lastUsed;                   // Steps used in last chunk
+	uint64_t numSteps;
+};
+
+#define CHECKPOINT_MAGIC "KUSKCCKP"	// First 8 bytes of every checkpoint file
+#define CHECKPOINT_VERSION 1
+#define CHECKPOINT_READ_STEPS 16384	// Steps read back per read when resuming
 
-// Definition for Room struct
+// Where the world of a checkpointed game came from
+enum CheckpointSource
+{
+	CHECKPOINT_DIRECTORY,                // A rooms directory
+	CHECKPOINT_ARCHIVE,                  // A world in WORLD_ARCHIVE_NAME
+	CHECKPOINT_EMBEDDED                  // The world compiled into the program
+};
+
+// Start of a checkpoint file. Each room the player moves to follows it as a uint32_t,
+// so saving a move is one 4 byte append and the file size gives the steps taken.
+struct CheckpointHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t source;                     // CheckpointSource
+	char directory[256];                 // Rooms directory, for CHECKPOINT_DIRECTORY
+	uint64_t archiveWorld;               // World number, for CHECKPOINT_ARCHIVE
+	uint32_t numRooms;                   // The rest must match the world, so a game is
+	uint32_t numConnections;             // never resumed in a world it was not played in
+	uint32_t startRoom;
+	uint32_t endRoom;
+	uint32_t stringPoolSize;
+	uint32_t reserved;
+};
+
+// Checkpoint file of the console game
+struct Checkpoint
+{
+	const char *fileName;
+	int fd;                              // -1 when games are not checkpointed
+	bool resuming;                       // File held a game, header says where
+	bool failed;                         // A save failed, later moves are not saved
+	struct CheckpointHeader header;
+	struct PathLog path;                 // Steps read back, handed over to the game
+	uint32_t currentRoom;
+};
+struct Checkpoint checkpoint = { .fd = -1 };
+
+#define PROMPT_CHUNK_SIZE 65536	// Bytes of prompts held by one render cache chunk
+#define PROMPT_BUFFER_SIZE 8192	// stdout buffer, a whole turn goes out in one write
+
+// Block of formatted prompts, never moved once allocated
+struct PromptChunk
+{
+	struct PromptChunk *next;
+	size_t size, used;
+	char text[];
+};
+
+// Prompt of every room shown so far. A room's prompt never changes, so it is
+// formatted once and every later turn there copies the same bytes.
+struct PromptCache
+{
+	const char **prompts;                // NULL until the room is first shown
+	uint32_t *lengths;
+	struct PromptChunk *chunks;          // Newest first
+};
+struct PromptCache promptCache;	// Shared by every game, the server runs on one thread
+
+#define INPUT_LINE_SIZE 64	// Longest line read from a player, longer lines match nothing
+#define MATCH_LIST_NAMES 16	// Matching connections named when input is not enough
+#define MATCH_TEXT_SIZE 1024	// Bytes of the message naming them
+#define MOVE_AMBIGUOUS (WORLD_NO_ROOM - 1)	// Input starts more than one connection's name
+
+// Connections whose names start with what a player typed, ignoring case
+struct Matches
+{
+	int count;                           // All that matched, only MATCH_LIST_NAMES are kept
+	uint32_t rooms[MATCH_LIST_NAMES];
+	const char *names[MATCH_LIST_NAMES];
+};
+
+// Built the first time a player types something that is not an exact name, see findMatches
+struct WorldMatcher nameMatcher;
+
+// Definition for Room struct, only used while reading text room files. Names point
+// into the file contents, which are terminated in place.
 struct Room
 {
-	char name[9];                        // Max of 8 characters + null terminator
-	char type[12]; 	                     // START_ROOM, END_ROOM, MID_ROOM
-	int numConnections;                  // Must be between 3 and 6
-	struct Room* outboundConnections[6]; // Declare max for struct size
-	char connectionArray[6][10];	     // String array of connection names
+	const char *name;                    // Max of 8 characters
+	uint8_t type;                        // START_ROOM, END_ROOM, MID_ROOM
+	uint8_t numConnections;              // Must be between 3 and 6
+	const char *connectionArray[6];      // Names of connected rooms
+};
+
+// Rooms parsed so far, grows as rooms are found
+struct RoomList
+{
+	struct Room *rooms;
+	int count;
+	int capacity;
 };
 
+#define SERVER_MAX_EVENTS 256	// Events handled per epoll_wait
+#define SESSION_OUTPUT_LIMIT 8192	// Unsent bytes a session may pile up before it is dropped
+#define SESSION_RECEIVE_SIZE 1024	// Bytes read from a player per recv
+
+// One player connected to the server. Only the world is shared, and it is read only.
+struct Session
+{
+	int fd;
+	uint32_t currentRoom;
+	uint32_t id;                         // Session number in the event log
+	bool foundEnd;
+	struct PathLog path;                 // Rooms visited so far
+	struct PathChunk *sendChunk;         // Next part of the path to send once END is found
+	uint32_t sendIndex;
+	bool sendingPath;
+	char input[INPUT_LINE_SIZE];         // Partial line read so far
+	uint32_t inputLength;
+	bool discarding;                     // Line was too long, skip to newline
+	char received[SESSION_RECEIVE_SIZE]; // Bytes read but not yet handled
+	uint32_t receivedNext, receivedEnd;
+	bool inputBlocked;                   // Stopped handling lines until output drains
+	bool closing;                        // Close once output is sent
+	bool dropped;                        // Player stopped reading, close without sending
+	char *output;                        // Bytes waiting to be sent
+	size_t outputLength, outputSent, outputCapacity;
+	struct Session *previous, *next;     // Every open session, so shutdown can free them
+};
+
+volatile sig_atomic_t serverRunning = 1;
+struct Session *openSessions = NULL;
+
 // Function Declarations
 void findNewestDirectory(char*);
-void getFileNames(char[NUM_ROOMS][40]);
-void buildRoomArray(struct Room*);
-void setConnections(struct Room*);
-void playGame(struct Room*);
+bool loadWorld(const char*, struct World*);
+int getFileNames(const char*, char***);
+const char *fieldValue(char*, const char*);
+bool checkName(const char*, const char*, int);
+bool parseRooms(char*, size_t, const char*, struct RoomList*);
+bool buildRoomArray(const char*, struct RoomList*, char**);
+bool worldFromRooms(struct Room*, struct World*);
+bool setConnections(struct Room*, struct World*);
+bool pathAppend(struct PathLog*, uint32_t);
+struct PathChunk *pathBegin(const struct PathLog*);
+uint32_t pathChunkUsed(const struct PathLog*, const struct PathChunk*);
+void pathClear(struct PathLog*);
+void pathFree(struct PathLog*);
+bool checkpointOpen(struct Checkpoint*, const char*);
+bool checkpointAttach(struct Checkpoint*, const struct WorldHeader*, const char*, uint64_t);
+void checkpointMove(struct Checkpoint*, uint32_t);
+void checkpointClose(struct Checkpoint*, bool);
+bool promptCacheInit(struct PromptCache*, uint32_t);
+const char *roomPrompt(struct PromptCache*, const struct World*, uint32_t, uint32_t*);
+void promptCacheFree(struct PromptCache*);
+bool playGame(const struct World*);
+bool readCommand(char*);
+void formatHint(const struct World*, uint32_t, char*);
+uint32_t findMove(const struct World*, uint32_t, const char*, struct Matches*);
+void findMatches(const struct World*, uint32_t, const char*, struct Matches*);
+void findLazyMatches(const struct CachedRoom*, const struct CachedRoom*, const char*, struct Matches*);
+uint32_t pickMatch(const struct Matches*, const char*);
+void formatMatches(const struct Matches*, const char*, bool, char*);
+bool isCompletion(char*);
+bool playLazyGame(const char*, uint32_t);
+bool readLazyRoom(struct WorldCache*, uint32_t, struct CachedRoom*, struct CachedRoom*);
+enum BatchToken nextBatchToken(struct BatchInput*, char**);
+bool runBatch(const struct World*, const char*);
+bool walksCanEnd(const struct World*);
+uint32_t walkRandom(uint64_t*);
+int walkBucket(uint64_t);
+uint64_t walkBucketLow(int);
+uint64_t walkPercentile(const uint64_t*, uint64_t, double);
+void *runWalkJob(void*);
+bool runWalks(const struct World*, uint64_t, int, uint64_t);
+void stopServer(int);
+bool sendToSession(struct Session*, const char*, ...);
+bool flushSession(struct Session*);
+void sendPrompt(const struct World*, struct Session*);
+void handleLine(const struct World*, struct Session*, char*);
+void queuePath(const struct World*, struct Session*);
+bool readSession(const struct World*, struct Session*);
+void closeSession(int, struct Session*);
+bool runServer(const struct World*, const char*);
+void usage(const char*);
+void formatTime(time_t);
+bool startTimeService(bool);
+void stopTimeService();
 void* writeTime(void*);
+void getTime(char*);
 void readTime();
+bool startEventLog(const char*, const char*);
+void stopEventLog();
+void logEvent(enum EventType, uint32_t, uint32_t, uint32_t);
+int formatEvent(const struct GameEvent*, char*);
+void* writeEvents(void*);
 
 /***************************************************************************************
 * Main Function
 ****************************************************************************************/
-int main(void)
+int main(int argc, char *argv[])
 {
-	struct Room roomArray[NUM_ROOMS];
-	buildRoomArray(roomArray);        // Calls getFileNames and setConnections
-	playGame(roomArray);
+	bool writeTimeFile = false;	// Write currentTime.txt when time is asked for
+	const char *batchFile = NULL;	// Replay moves from this file instead of playing
+	const char *socketPath = NULL;	// Serve sessions on this socket instead of playing
+	bool checkWorld = false;	// Check every room of the world before playing
+	const char *statsFile = NULL;	// Write timings and latencies here, - for stderr
+	uint32_t lazyRooms = 0;		// Read rooms as they are reached, holding this many
+	uint64_t numWalks = 0;		// Random walks to run instead of playing
+	int numThreads = sysconf(_SC_NPROCESSORS_ONLN);	// Threads running walks
+	uint64_t walkSeed = 1;		// Same seed and threads give the same walks
+	const char *archiveWorld = NULL;	// Play this world number from the archive, or latest
+	const char *eventFile = NULL;	// Record gameplay events here
+	const char *eventFormat = "jsonl";	// Or binary
+	const char *checkpointFile = NULL;	// Save the game here after every move, resume it from here
+
+	static struct option longOptions[] =
+	{
+		{"time-file", no_argument,       NULL, 't'},
+		{"batch",     required_argument, NULL, 'b'},
+		{"server",    required_argument, NULL, 's'},
+		{"check",     no_argument,       NULL, 'c'},
+		{"stats",     required_argument, NULL, 'S'},
+		{"lazy",      required_argument, NULL, 'l'},
+		{"walks",     required_argument, NULL, 'w'},
+		{"threads",   required_argument, NULL, 'j'},
+		{"seed",      required_argument, NULL, 'r'},
+		{"archive",   required_argument, NULL, 'a'},
+		{"events",    required_argument, NULL, 'e'},
+		{"event-format", required_argument, NULL, 'E'},
+		{"checkpoint", required_argument, NULL, 'k'},
+		{"help",      no_argument,       NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+
+	int option;
+	while ((option = getopt_long(argc, argv, "tb:s:cS:l:w:j:r:a:e:E:k:h", longOptions, NULL)) != -1)
+	{
+		switch (option)
+		{
+			case 't':
+				writeTimeFile = true;
+				break;
+			case 'b':
+				batchFile = optarg;
+				break;
+			case 's':
+				socketPath = optarg;
+				break;
+			case 'c':
+				checkWorld = true;
+				break;
+			case 'S':
+				statsFile = optarg;
+				break;
+			case 'l':
+				lazyRooms = strtoul(optarg, NULL, 10);
+				if(lazyRooms < WORLD_CACHE_MIN_ROOMS)
+				{
+					fprintf(stderr, "Lazy loading needs to hold at least %d rooms\n", WORLD_CACHE_MIN_ROOMS);
+					return 1;
+				}
+				break;
+			case 'w':
+				numWalks = strtoull(optarg, NULL, 10);
+				break;
+			case 'j':
+				numThreads = atoi(optarg);
+				break;
+			case 'r':
+				walkSeed = strtoull(optarg, NULL, 10);
+				break;
+			case 'a':
+				archiveWorld = optarg;
+				break;
+			case 'e':
+				eventFile = optarg;
+				break;
+			case 'E':
+				eventFormat = optarg;
+				break;
+			case 'k':
+				checkpointFile = optarg;
+				break;
+			default:
+				usage(argv[0]);
+				return option == 'h' ? 0 : 1;
+		}
+	}
+
+	if(lazyRooms > 0 && (batchFile != NULL || socketPath != NULL || checkWorld || numWalks > 0 ||
+	                     archiveWorld != NULL))
+	{
+		fprintf(stderr, "--lazy is only for interactive play\n");
+		return 1;
+	}
+	if(numWalks > 0 && (batchFile != NULL || socketPath != NULL))
+	{
+		fprintf(stderr, "--walks runs on its own, not with --batch or --server\n");
+		return 1;
+	}
+	if(eventFile != NULL && (batchFile != NULL || numWalks > 0))
+	{
+		fprintf(stderr, "--events records played games, not --batch or --walks\n");
+		return 1;
+	}
+	if(strcmp(eventFormat, "jsonl") != 0 && strcmp(eventFormat, "binary") != 0)
+	{
+		fprintf(stderr, "Event format must be jsonl or binary\n");
+		return 1;
+	}
+	if(checkpointFile != NULL && (batchFile != NULL || socketPath != NULL || numWalks > 0))
+	{
+		fprintf(stderr, "--checkpoint saves console games, not --batch, --server or --walks\n");
+		return 1;
+	}
+
+	// Before the time thread starts, see statsStart
+	if(statsFile != NULL && !statsStart("adventure", statsFile))
+		return 1;
+
+	// A saved game is played on in the world it was started in
+	if(checkpointFile != NULL && !checkpointOpen(&checkpoint, checkpointFile))
+		return 1;
+
+#ifdef KUSKC_EMBEDDED
+	// World is compiled in, nothing is read before the first prompt
+	if(lazyRooms > 0)
+	{
+		fprintf(stderr, "World is compiled in, --lazy does not apply\n");
+		return 1;
+	}
+	struct World world = embeddedWorld;
+	if(checkpoint.resuming && checkpoint.header.source != CHECKPOINT_EMBEDDED)
+	{
+		fprintf(stderr, "%s was saved in a world that is not compiled in\n", checkpointFile);
+		return 1;
+	}
+	if(checkpoint.fd >= 0 && !checkpointAttach(&checkpoint, world.header, NULL, 0))
+		return 1;
+#else
+	// Set directoryName variable and memset it to null terminators
+	char directoryName[256];
+	memset(directoryName, '\0', 256);
+
+	char resumeWorld[24];
+	if(checkpoint.resuming)
+	{
+		if(checkpoint.header.source == CHECKPOINT_EMBEDDED)
+		{
+			fprintf(stderr, "%s was saved in a world compiled into the program, see make embedded\n", checkpointFile);
+			return 1;
+		}
+		if(checkpoint.header.source == CHECKPOINT_ARCHIVE && lazyRooms > 0)
+		{
+			fprintf(stderr, "%s was saved in an archived world, --lazy needs a rooms directory\n", checkpointFile);
+			return 1;
+		}
+		archiveWorld = NULL;
+		if(checkpoint.header.source == CHECKPOINT_DIRECTORY)
+			strcpy(directoryName, checkpoint.header.directory);
+		else
+		{
+			snprintf(resumeWorld, sizeof(resumeWorld), "%" PRIu64, checkpoint.header.archiveWorld);
+			archiveWorld = resumeWorld;
+		}
+	}
+
+	// Open the most recently created directory, unless a world from the archive was asked for
+	uint64_t start = STATS_NOW();
+	if(archiveWorld == NULL && directoryName[0] == '\0')
+		findNewestDirectory(directoryName);
+	STATS_TIMER(TIMER_FIND_DIRECTORY, start);
+
+	// Worlds built with -f archive have no directory, play the newest of them
+	if(archiveWorld == NULL && directoryName[0] == '\0' && lazyRooms == 0 &&
+	   access(WORLD_ARCHIVE_NAME, F_OK) == 0)
+		archiveWorld = "latest";
+	if(archiveWorld == NULL && directoryName[0] == '\0')
+	{
+		fprintf(stderr, "No rooms directory found, run buildrooms first\n");
+		return 1;
+	}
+
+	// Lazy games never build a World, rooms come straight from world.bin
+	if(lazyRooms > 0)
+	{
+		if(eventFile != NULL && !startEventLog(eventFile, eventFormat))
+			return 1;
+		if(!startTimeService(writeTimeFile))
+		{
+			stopEventLog();
+			return 1;
+		}
+		bool finished = playLazyGame(directoryName, lazyRooms);
+		stopTimeService();
+		stopEventLog();
+		checkpointClose(&checkpoint, finished);
+		pthread_mutex_destroy(&my_mutex);
+		pthread_cond_destroy(&timeService.wake);
+		return finished ? 0 : 1;
+	}
+
+	struct World world;
+	uint64_t worldId = 0;
+	if(archiveWorld != NULL)
+	{
+		worldId = strcmp(archiveWorld, "latest") == 0 ? WORLD_ARCHIVE_LATEST : strtoull(archiveWorld, NULL, 10);
+		if(worldId == WORLD_ARCHIVE_LATEST && strcmp(archiveWorld, "latest") != 0)
+		{
+			fprintf(stderr, "Archive worlds are numbered from 1, or use latest\n");
+			return 1;
+		}
+		if(!worldArchiveLoad(WORLD_ARCHIVE_NAME, &worldId, &world))
+			return 1;
+	}
+	else if(!loadWorld(directoryName, &world))
+		return 1;
+	if(checkpoint.fd >= 0 &&
+	   !checkpointAttach(&checkpoint, world.header, archiveWorld == NULL ? directoryName : NULL, worldId))
+	{
+		worldClose(&world);
+		return 1;
+	}
+#endif
+	if(checkWorld && !worldCheck(&world))
+	{
+		worldClose(&world);
+		return 1;
+	}
+
+	// Batch runs need no time thread, time is not a move there
+	if(batchFile != NULL)
+	{
+		bool finished = runBatch(&world, batchFile);
+		worldMatcherFree(&nameMatcher);
+		worldClose(&world);
+		return finished ? 0 : 1;
+	}
+	if(numWalks > 0)
+	{
+		bool finished = runWalks(&world, numWalks, numThreads, walkSeed);
+		worldClose(&world);
+		return finished ? 0 : 1;
+	}
+
+	if(eventFile != NULL && !startEventLog(eventFile, eventFormat))
+	{
+		worldClose(&world);
+		return 1;
+	}
+	// Started once, every time command after this is a memory read
+	if(!startTimeService(writeTimeFile))
+	{
+		stopEventLog();
+		worldClose(&world);
+		return 1;
+	}
+
+	bool finished = promptCacheInit(&promptCache, world.header->numRooms);
+	if(finished && socketPath != NULL)
+		finished = runServer(&world, socketPath);
+	else if(finished)
+	{
+		finished = playGame(&world);
+		checkpointClose(&checkpoint, finished);
+	}
+	promptCacheFree(&promptCache);
+	worldMatcherFree(&nameMatcher);
+	worldClose(&world);
+	stopTimeService();
+	stopEventLog();
 
 	// Clean up mutex
 	pthread_mutex_destroy(&my_mutex);
+	pthread_cond_destroy(&timeService.wake);
 	
-	return 0;
+	return finished ? 0 : 1;
 }
 
 
 /***************************************************************************************
-* Finds name of newest directory and setes directoryName pointer to it 
+* Prints command line options
+****************************************************************************************/
+void usage(const char *programName)
+{
+	fprintf(stderr, "Usage: %s [options]\n", programName);
+	fprintf(stderr, "  -t, --time-file  also write currentTime.txt when time is asked for\n");
+	fprintf(stderr, "  -b, --batch F    replay sessions from file F (- for stdin), one per line\n");
+	fprintf(stderr, "  -s, --server P   serve many players on Unix domain socket P\n");
+	fprintf(stderr, "  -c, --check      check every room of the world file before starting\n");
+	fprintf(stderr, "  -l, --lazy N     read rooms from world.bin as they are reached, holding at\n");
+	fprintf(stderr, "                   most N, so start up does not depend on the world size\n");
+	fprintf(stderr, "  -a, --archive W  play world number W from %s, or latest for the newest,\n", WORLD_ARCHIVE_NAME);
+	fprintf(stderr, "                   which is also played when there is no rooms directory\n");
+	fprintf(stderr, "  -w, --walks N    run N random walks from START to END and print how many\n");
+	fprintf(stderr, "                   steps they took, instead of playing\n");
+	fprintf(stderr, "  -j, --threads T  threads running walks (default all cores)\n");
+	fprintf(stderr, "  -r, --seed S     seed of the walks, the same seed and threads give the same\n");
+	fprintf(stderr, "                   walks (default 1)\n");
+	fprintf(stderr, "  -k, --checkpoint F\n");
+	fprintf(stderr, "                   save the game to F after every move. If F already holds a\n");
+	fprintf(stderr, "                   game, carry on with it in the world it was started in\n");
+	fprintf(stderr, "  -e, --events F   record moves, invalid input, time and hint requests and game\n");
+	fprintf(stderr, "                   ends to F, written by a background thread\n");
+	fprintf(stderr, "  -E, --event-format jsonl|binary\n");
+	fprintf(stderr, "                   one JSON object per line (default) or fixed size records\n");
+	fprintf(stderr, "  -S, --stats F    write timings and latencies as JSON to F (- for stderr) at exit\n");
+	fprintf(stderr, "                   and on SIGUSR1, needs a -DKUSKC_STATS build\n");
+	fprintf(stderr, "  -h, --help       show this message\n");
+}
+
+/***************************************************************************************
+* Finds name of newest directory and setes directoryName pointer to it. Reads the
+* manifest buildrooms keeps, and only scans the directory if there is none.
 ****************************************************************************************/
 void findNewestDirectory(char *directoryName)
 {
+	uint64_t sequence;
+	if(worldLatest(directoryName, 256, &sequence))
+		return;
+
 	// Largely taken from 2.4 from Canvas
-	int newestDirTime = -1; // Modified timestamp of newest subdir examined
+	struct timespec newestDirTime = { -1, 0 }; // Modified timestamp of newest subdir examined
         char targetDirPrefix[32] = "kuskc.rooms."; // Prefix we're looking for
         char newestDirName[30]; // Holds the name of the newest dir that contains prefix
         memset(newestDirName, '\0', sizeof(newestDirName));
@@ -76,11 +694,15 @@ void findNewestDirectory(char *directoryName)
   		{
 	    		if (strstr(fileInDir->d_name, targetDirPrefix) != NULL) // If entry has prefix
     			{
-       			 	stat(fileInDir->d_name, &dirAttributes); // Get attributes of the entry
+       			 	if (stat(fileInDir->d_name, &dirAttributes) < 0 || !S_ISDIR(dirAttributes.st_mode))
+					continue; // Skip anything that is not a rooms directory
 
-        			if ((int)dirAttributes.st_mtime > newestDirTime) // If this time is bigger
+				// Nanoseconds break ties between worlds built in the same second
+        			if (dirAttributes.st_mtim.tv_sec > newestDirTime.tv_sec ||
+				    (dirAttributes.st_mtim.tv_sec == newestDirTime.tv_sec &&
+				     dirAttributes.st_mtim.tv_nsec > newestDirTime.tv_nsec))
         			{
-          				newestDirTime = (int)dirAttributes.st_mtime;
+          				newestDirTime = dirAttributes.st_mtim;
           				memset(newestDirName, '\0', sizeof(newestDirName));
           				strcpy(newestDirName, fileInDir->d_name);
     	       	                 }
@@ -96,34 +718,86 @@ void findNewestDirectory(char *directoryName)
 
 
 
-void getFileNames(char fileNames[NUM_ROOMS][40])
+/***************************************************************************************
+* Maps world.bin from directory if buildrooms wrote one, otherwise reads the text
+* room files and packs them into a world in memory
+****************************************************************************************/
+bool loadWorld(const char *directoryName, struct World *world)
 {
-	// Set directoryName variable and memset it to null terminators
-	char directoryName[256];
-	memset(directoryName, '\0', 256);	
+	char fileName[300];
+	sprintf(fileName, "%s/%s", directoryName, WORLD_FILE_NAME);
 
-	// Open the most recently created directory
-	findNewestDirectory(directoryName);
+	// Binary world is used in place, no parsing needed
+	if(access(fileName, F_OK) == 0)
+		return worldOpen(world, fileName);
 
-	// SEE IF ANY VARIABLES BELOW CAN BE DELETED
+	// Rooms point into text, so it is freed only after the world is packed
+	struct RoomList roomList = { NULL, 0, 0 };
+	char *text = NULL;
+	uint64_t start = STATS_NOW();
+	bool loaded = buildRoomArray(directoryName, &roomList, &text);        // Calls getFileNames
+	STATS_TIMER(TIMER_READ_ROOMS, start);
+	if(loaded)
+		loaded = worldFromRooms(roomList.rooms, world);
+	start = STATS_NOW();
+	if(loaded && !setConnections(roomList.rooms, world))
+	{
+		worldClose(world);
+		loaded = false;
+	}
+	STATS_TIMER(TIMER_SET_CONNECTIONS, start);
+	// Text files carry no distances, find them now. Diameter is left for buildrooms.
+	if(loaded)
+		worldComputeDistances(world, 1);
+	free(roomList.rooms);
+	free(text);
+	return loaded;
+}
 
+/***************************************************************************************
+* Fills fileNames with paths of the room files in directoryName, returns how many
+* there are or -1 if the directory can not be read
+****************************************************************************************/
+int getFileNames(const char *directoryName, char ***fileNames)
+{
 	// Need a way to read in every file within directory
 	DIR* FD;	// Directory pointer
         struct dirent* fileIn;
 
 	FD = opendir(directoryName);
+	if (FD == NULL)
+	{
+		perror(directoryName);
+		return -1;
+	}
 
-	int x = 0;
+	int x = 0, capacity = 16;
+	*fileNames = malloc(sizeof(char*) * capacity);
 	
 	// While files in directory can be read
-        while ((fileIn = readdir(FD)) && x < 7)  
+        while (*fileNames != NULL && (fileIn = readdir(FD)))
         {
 		// Leave loop if trying to go into parent directory
         	if (!strcmp (fileIn->d_name, "."))
             		continue;
         	if (!strcmp (fileIn->d_name, ".."))    
             		continue;
-		sprintf(fileNames[x], "%s/%s", directoryName, fileIn->d_name);
+		// Binary copy of the same rooms is not a room file
+        	if (!strcmp (fileIn->d_name, WORLD_FILE_NAME))
+            		continue;
+
+		if (x == capacity)
+		{
+			capacity *= 2;
+			char **grown = realloc(*fileNames, sizeof(char*) * capacity);
+			if (grown == NULL)
+				break;
+			*fileNames = grown;
+		}
+		(*fileNames)[x] = malloc(strlen(directoryName) + strlen(fileIn->d_name) + 2);
+		if ((*fileNames)[x] == NULL)
+			break;
+		sprintf((*fileNames)[x], "%s/%s", directoryName, fileIn->d_name);
 
 		// Increment x every time in loop
 		x++; 
@@ -131,220 +805,2279 @@ void getFileNames(char fileNames[NUM_ROOMS][40])
 
 	// Close directory when done
 	closedir(FD);
+	if (*fileNames == NULL)
+	{
+		perror("malloc");
+		return -1;
+	}
+	return x;
 }
 
 /***************************************************************************************
-* Reads in data from room files and creates roomArray 
+* Returns what follows label on line with surrounding blanks removed, or NULL if line
+* does not start with label
 ****************************************************************************************/
-void buildRoomArray(struct Room *roomArray)
+const char *fieldValue(char *line, const char *label)
 {
-	FILE *fp;
-	int x;
+	size_t labelLength = strlen(label);
+	if(strncmp(line, label, labelLength) != 0)
+		return NULL;
 
-	// Read each file to its respective element in Room array
-	char fileNames[NUM_ROOMS][40];
-	for(x = 0; x < NUM_ROOMS; x++)
-		memset(fileNames[x], '\0', 40);
-	
-	// Fill fileNames char array with correct file names 
-	getFileNames(fileNames);
-
-	char lineIn[30];
-	memset(lineIn, '\0', 30);
-	int numConnections;
+	char *value = line + labelLength;
+	while(*value == ' ' || *value == '\t')
+		value++;
+	char *end = value + strlen(value);
+	while(end > value && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r'))
+		*--end = '\0';
+	return value;
+}
 
-	for(x= 0; x < 7; x++)
+/***************************************************************************************
+* Checks room name is one word of 1 to 8 characters, reports error if not
+****************************************************************************************/
+bool checkName(const char *name, const char *source, int lineNumber)
+{
+	size_t length = strcspn(name, " \t");
+	if(length == 0 || name[length] != '\0' || length > 8)
 	{
-		// Opens each file 
-		fp = fopen(fileNames[x], "r");
-	
-		// initializes room name before other properties
-		fgets(lineIn, 30, fp);
-		sscanf(lineIn, "%*s %*s %s", roomArray[x].name);
-	
-		// Resets number of connections
-		numConnections = 0;
-
-		// While fgets can read new lines
-		while(fgets(lineIn, 30, fp))
-		{
-			if(lineIn[0] == 'C')
-			{
-				// Connections rooms start with CONNECTION
-				sscanf(lineIn, "%*s %*s %s", roomArray[x].connectionArray[numConnections]);
-				// Increment number of connections by one after adding names
-				numConnections = numConnections + 1;
-				
-			}
-			else
-			{
-				// If not starting with a C will be line giving ROOM TYPE
-				fgets(lineIn, 30, fp);
-				sscanf(lineIn, "%*s %*s %s", roomArray[x].type);
-			}	
-		}
-		
-		roomArray[x].numConnections = numConnections;
-
-		// Close file when done
-		fclose(fp);
+		fprintf(stderr, "%s:%d: room name must be one word of 1 to 8 characters\n", source, lineNumber);
+		return false;
 	}
-
-	// Points rooms that are connected to each other
-	setConnections(roomArray);
+	return true;
 }
 
-
 /***************************************************************************************
-* Diplays rooms and information about them, for troubleshooting
+* Parses one or more room files laid end to end in text. Lines are terminated in
+* place and rooms point straight into text, nothing is copied. text[length] must be
+* writable. Errors are reported as source:line.
 ****************************************************************************************/
-void setConnections(struct Room *roomArray)
+bool parseRooms(char *text, size_t length, const char *source, struct RoomList *roomList)
 {
-	// Loop through every element in room Array
-	int x, y, z;
-	for(x = 0; x < NUM_ROOMS; x++)
+	char *line = text;
+	char *textEnd = text + length;
+	struct Room *room = NULL;	// Room whose ROOM TYPE has not been seen yet
+	int lineNumber = 0;
+	const char *value;
+
+	while(line < textEnd)
 	{
-		// Loop through every element in outboundConnections
-		for(y = 0; y < 6; y++)
+		char *lineEnd = memchr(line, '\n', textEnd - line);
+		if(lineEnd == NULL)
+			lineEnd = textEnd;
+		*lineEnd = '\0';
+		lineNumber++;
+
+		if((value = fieldValue(line, "ROOM NAME:")) != NULL)
 		{
-			// LOOP THROUGH ALL ROOMS AGAIN?
-			// If name in connectionArray is same as a Room name, connect
-			for(z = 0; z < NUM_ROOMS; z++)
+			if(room != NULL)
+			{
+				fprintf(stderr, "%s:%d: room %s has no ROOM TYPE\n", source, lineNumber, room->name);
+				return false;
+			}
+			if(!checkName(value, source, lineNumber))
+				return false;
+
+			if(roomList->count == roomList->capacity)
 			{
-				if(!strcmp(roomArray[x].connectionArray[y], roomArray[z].name))
+				int capacity = roomList->capacity ? roomList->capacity * 2 : 16;
+				struct Room *grown = realloc(roomList->rooms, sizeof(struct Room) * capacity);
+				if(grown == NULL)
 				{
-					roomArray[x].outboundConnections[y] = &roomArray[z];
+					perror("realloc");
+					return false;
 				}
+				roomList->rooms = grown;
+				roomList->capacity = capacity;
 			}
-		}	
+			room = &roomList->rooms[roomList->count++];
+			room->name = value;
+			room->numConnections = 0;
+		}
+		else if((value = fieldValue(line, "CONNECTION")) != NULL && room != NULL)
+		{
+			// Connections are numbered 1 to 6 in order
+			char *colon;
+			long number = strtol(value, &colon, 10);
+			if(*colon != ':' || number != room->numConnections + 1 || number > 6)
+			{
+				fprintf(stderr, "%s:%d: expected CONNECTION %d:\n", source, lineNumber,
+				        room->numConnections + 1);
+				return false;
+			}
+			value = colon + 1;
+			while(*value == ' ' || *value == '\t')
+				value++;
+			if(!checkName(value, source, lineNumber))
+				return false;
+			room->connectionArray[room->numConnections++] = value;
+		}
+		else if((value = fieldValue(line, "ROOM TYPE:")) != NULL && room != NULL)
+		{
+			if(!strcmp(value, "START_ROOM"))
+				room->type = START_ROOM;
+			else if(!strcmp(value, "END_ROOM"))
+				room->type = END_ROOM;
+			else if(!strcmp(value, "MID_ROOM"))
+				room->type = MID_ROOM;
+			else
+			{
+				fprintf(stderr, "%s:%d: unknown room type %s\n", source, lineNumber, value);
+				return false;
+			}
+			if(room->numConnections < 3)
+			{
+				fprintf(stderr, "%s:%d: room %s has %d connections, needs 3 to 6\n",
+				        source, lineNumber, room->name, room->numConnections);
+				return false;
+			}
+			room = NULL;
+		}
+		else if(strspn(line, " \t\r") != strlen(line))
+		{
+			// Anything but a blank line between rooms is an error
+			fprintf(stderr, "%s:%d: expected %s\n", source, lineNumber,
+			        room == NULL ? "ROOM NAME:" : "CONNECTION or ROOM TYPE:");
+			return false;
+		}
+
+		line = lineEnd + 1;
+	}
+
+	if(room != NULL)
+	{
+		fprintf(stderr, "%s:%d: room %s has no ROOM TYPE\n", source, lineNumber, room->name);
+		return false;
 	}
+	return true;
 }
 
 /***************************************************************************************
-* Diplays rooms and information about them, for troubleshooting
+* Reads every room file with one read each into text, then parses them in place.
+* Sets NUM_ROOMS to the number of rooms found.
 ****************************************************************************************/
-void playGame(struct Room *roomArray)
+bool buildRoomArray(const char *directoryName, struct RoomList *roomList, char **text)
 {
-	struct Room *currentRoom;	// Pointer to room user will be in 
-	char userInput[10];		// Input from user, rooms have length of 8
-	int numSteps = 0;		// Counts number of steps of user
-	char roomsVisited[100][10];     // Array of rooms visited
+	char **fileNames;
+	int numFiles = getFileNames(directoryName, &fileNames);
+	if(numFiles < 0)
+		return false;
+	STATS_COUNT(COUNTER_ROOM_FILES_READ, numFiles);
 
-	// Find starting
+	// Each file is followed by a terminator so the parser can end its last line
+	size_t *fileStarts = malloc(sizeof(size_t) * (numFiles + 1));
+	size_t textSize = 0, capacity = 4096;
+	*text = malloc(capacity);
+	bool readAll = fileStarts != NULL && *text != NULL;
 	int x;
-	for(x = 0; x < NUM_ROOMS; x++)
-		if(!strcmp(roomArray[x].type, "START_ROOM"))
-			currentRoom = &roomArray[x];
 
-	// Run game in while loop
-	// strcmp will return 0 when the match
-	while(strcmp(currentRoom->type, "END_ROOM"))
+	for(x = 0; x < numFiles && readAll; x++)
 	{
-		printf("CURRENT LOCATION: %s\nPOSSIBLE CONNECTIONS: ", currentRoom->name);
+		int fd = open(fileNames[x], O_RDONLY);
+		struct stat fileAttributes;
+		if(fd < 0 || fstat(fd, &fileAttributes) < 0)
+		{
+			perror(fileNames[x]);
+			if(fd >= 0)
+				close(fd);
+			readAll = false;
+			break;
+		}
 
-		// Loop will go through all outboundConnections
-		int x;
-		for(x = 0; x < currentRoom->numConnections - 1; x++)
-			printf("%s, ", currentRoom->outboundConnections[x]->name);
-	
-		// Print last room with a period
-		printf("%s.\n", currentRoom->outboundConnections[x]->name);
+		while(textSize + fileAttributes.st_size + 1 > capacity)
+			capacity *= 2;
+		char *grown = realloc(*text, capacity);
+		if(grown == NULL)
+		{
+			perror("realloc");
+			close(fd);
+			readAll = false;
+			break;
+		}
+		*text = grown;
 
-		// User interface and input
-		printf("WHERE TO? >");
-		scanf("%s", userInput);
-		printf("\n");
+		fileStarts[x] = textSize;
+		ssize_t bytesRead = 0;
+		size_t fileSize = 0;
+		while(fileSize < (size_t)fileAttributes.st_size &&
+		      (bytesRead = read(fd, *text + textSize + fileSize, fileAttributes.st_size - fileSize)) > 0)
+			fileSize += bytesRead;
+		close(fd);
 
-		if(strcmp(userInput, "time") == 0)
+		// A file cut short would be parsed as a room with missing lines
+		if(bytesRead < 0 || fileSize < (size_t)fileAttributes.st_size)
 		{
-			int resultInt;
-			pthread_t time_thread;
-			pthread_mutex_lock(&my_mutex);
-			// Creates new thread which will write time to currentTime.txt
-			resultInt = pthread_create(&time_thread,
-						   NULL,
-						   writeTime,
-						   NULL);
-			resultInt = pthread_join(time_thread, NULL);
-			pthread_mutex_unlock(&my_mutex);
-
-			// Displays time to user
-			readTime();
+			if(bytesRead < 0)
+				perror(fileNames[x]);
+			else
+				fprintf(stderr, "%s: read %zu of %jd bytes\n", fileNames[x], fileSize, (intmax_t)fileAttributes.st_size);
+			readAll = false;
+			break;
 		}
-		else
-		{
-			// Search if room exists
-			bool roomFound = false;
-			for(x = 0; x < currentRoom->numConnections; x++)
-			{
-				// If name entered matchese one of the listed rooms
-				if(strcmp(currentRoom->outboundConnections[x]->name, userInput) == 0)
-				{
-					// Reassign currentRoom pointer to selected room
-					currentRoom = currentRoom->outboundConnections[x];
-					strcpy(roomsVisited[numSteps], currentRoom->name);
-					numSteps++;
-					roomFound = true;
-				}
-			 }
-			// If userInput does not match any room, output error
-			if(!roomFound)
-				printf("HUH? I DON'T UNDERSTAND THAT ROOM. TRY AGAIN.\n");
-		}	
+		textSize += fileSize;
+		(*text)[textSize++] = '\0';
 	}
-	// Output message when user has found room
-	printf("YOU HAVE FOUND THE END ROOM. CONGRATULATIONS!\n");
-	printf("YOU TOOK %i STEPS. YOUR PATH TO VICTORY WAS:\n", numSteps);
-	int i;
-	// Prints list of rooms visited
-	for(i = 0; i < numSteps; i++)
+
+	// Parse only once text has stopped moving
+	for(x = 0; x < numFiles && readAll; x++)
 	{
-		printf("%s\n", roomsVisited[i]);
+		size_t fileEnd = (x + 1 < numFiles ? fileStarts[x + 1] : textSize) - 1;
+		readAll = parseRooms(*text + fileStarts[x], fileEnd - fileStarts[x], fileNames[x], roomList);
 	}
-	
-	// Take care of dangling pointers
-	currentRoom = NULL;
-}
 
+	for(x = 0; x < numFiles; x++)
+		free(fileNames[x]);
+	free(fileNames);
+	free(fileStarts);
+	if(!readAll)
+		return false;
 
-/***************************************************************************************
-* Writes the current time to time.txt
-****************************************************************************************/
-void* writeTime(void* arguments)
-{
-	// Looked here for info on using 
-	// https://www.tutorialspoint.com/c_standard_library/c_function_strftime.htm
-	
-	time_t currentTime;
-	struct tm* info;
-	char timeString[80];
-	time(&currentTime);
-	info = localtime(&currentTime);
-	// Parses time info into desired format
-	strftime(timeString, 80, "%l:%M%P, %A, %B %e, %Y", info);
+	// A game needs exactly one way in and one way out
+	int numStart = 0, numEnd = 0;
+	for(x = 0; x < roomList->count; x++)
+	{
+		numStart += roomList->rooms[x].type == START_ROOM;
+		numEnd += roomList->rooms[x].type == END_ROOM;
+	}
+	if(numStart != 1 || numEnd != 1)
+	{
+		fprintf(stderr, "%s: found %d START_ROOM and %d END_ROOM, need one of each\n",
+		        directoryName, numStart, numEnd);
+		return false;
+	}
 
-	FILE *filePointer;
-	// Opens file time will be written to
-	filePointer = fopen("currentTime.txt", "w");
-	// Prints time to file, overwriting anything that may already be there
-	fprintf(filePointer, "%s\n", timeString);
-	// Close file when done
-	fclose(filePointer); 
+	NUM_ROOMS = roomList->count;
+	return true;
 }
 
 
 /***************************************************************************************
-* Reads the time on time.txt and outputs it to user in console
+* Packs rooms read from text files into a world in memory so the game only has to
+* deal with one layout. Connections are filled in by setConnections once the name
+* index is built.
 ****************************************************************************************/
-void readTime()
+bool worldFromRooms(struct Room *roomArray, struct World *world)
 {
-	FILE *filePointer;
-	// Opens file time will be read from
-	filePointer = fopen("currentTime.txt", "r");
-	char timeString[40];
-	fgets(timeString, 40, filePointer);
-	printf("%s\n\n", timeString);	
+	// Count sizes of connection array and string pool
+	uint32_t numConnections = 0;
+	uint32_t stringPoolSize = 0;
+	int x;
+	for(x = 0; x < NUM_ROOMS; x++)
+	{
+		numConnections += roomArray[x].numConnections;
+		stringPoolSize += strlen(roomArray[x].name) + 1;
+	}
+
+	if(!worldCreate(world, NUM_ROOMS, numConnections, stringPoolSize))
+		return false;
+
+	// Sections are read only once the world is built, fill them through writable pointers
+	struct WorldHeader *header = world->base;
+	uint32_t *offsets = (uint32_t*)world->offsets;
+	uint32_t *names = (uint32_t*)world->names;
+	char *strings = (char*)world->strings;
+
+	uint32_t nextConnection = 0;
+	uint32_t nextString = 0;
+	for(x = 0; x < NUM_ROOMS; x++)
+	{
+		if(roomArray[x].type == START_ROOM)
+			header->startRoom = x;
+		else if(roomArray[x].type == END_ROOM)
+			header->endRoom = x;
 
-	// Close file when done reading it
-	fclose(filePointer);
+		offsets[x] = nextConnection;
+		nextConnection += roomArray[x].numConnections;
+
+		names[x] = nextString;
+		strcpy(strings + nextString, roomArray[x].name);
+		nextString += strlen(roomArray[x].name) + 1;
+	}
+	offsets[NUM_ROOMS] = nextConnection;
+	if(!worldBuildIndex(world))
+	{
+		worldClose(world);
+		return false;
+	}
+	return true;
+}
+
+/***************************************************************************************
+* Turns connection names into room numbers with one index lookup per connection
+****************************************************************************************/
+bool setConnections(struct Room *roomArray, struct World *world)
+{
+	uint32_t *targets = (uint32_t*)world->targets;
+
+	// Loop through every element in room Array
+	int x, y;
+	for(x = 0; x < NUM_ROOMS; x++)
+	{
+		// Only the connections the room actually has
+		for(y = 0; y < roomArray[x].numConnections; y++)
+		{
+			uint32_t room = worldFindRoom(world, roomArray[x].connectionArray[y]);
+			if(room == WORLD_NO_ROOM)
+			{
+				fprintf(stderr, "Room %s is connected to unknown room %s\n",
+				        roomArray[x].name, roomArray[x].connectionArray[y]);
+				return false;
+			}
+			targets[world->offsets[x] + y] = room;
+		}
+	}
+	return true;
+}
+
+/***************************************************************************************
+* Adds room to the end of path, false if out of memory
+****************************************************************************************/
+bool pathAppend(struct PathLog *path, uint32_t room)
+{
+	if(path->last == NULL || path->lastUsed == PATH_CHUNK_STEPS)
+	{
+		// Chunks kept by pathClear are used again before new ones are made
+		struct PathChunk *chunk = path->last != NULL ? path->last->next : path->first;
+		if(chunk == NULL)
+		{
+			chunk = malloc(sizeof(struct PathChunk));
+			if(chunk == NULL)
+				return false;
+			chunk->next = NULL;
+			if(path->last != NULL)
+				path->last->next = chunk;
+			else
+				path->first = chunk;
+		}
+		path->last = chunk;
+		path->lastUsed = 0;
+	}
+	path->last->rooms[path->lastUsed++] = room;
+	path->numSteps++;
+	return true;
+}
+
+/***************************************************************************************
+* Returns the first chunk holding steps of path, NULL if it is empty. Chunks kept by
+* pathClear are still linked from path->first, so loops over a path start here.
+****************************************************************************************/
+struct PathChunk *pathBegin(const struct PathLog *path)
+{
+	return path->last != NULL ? path->first : NULL;
+}
+
+/***************************************************************************************
+* Returns how many steps of chunk are in use. Chunks after the last one hold nothing,
+* so loops over a path stop at path->last.
+****************************************************************************************/
+uint32_t pathChunkUsed(const struct PathLog *path, const struct PathChunk *chunk)
+{
+	if(path->last == NULL)
+		return 0;
+	return chunk == path->last ? path->lastUsed : PATH_CHUNK_STEPS;
+}
+
+/***************************************************************************************
+* Empties path but keeps its chunks
+****************************************************************************************/
+void pathClear(struct PathLog *path)
+{
+	path->last = NULL;
+	path->lastUsed = 0;
+	path->numSteps = 0;
+}
+
+/***************************************************************************************
+* Frees every chunk of path
+****************************************************************************************/
+void pathFree(struct PathLog *path)
+{
+	while(path->first != NULL)
+	{
+		struct PathChunk *next = path->first->next;
+		free(path->first);
+		path->first = next;
+	}
+	pathClear(path);
+}
+
+/***************************************************************************************
+* Opens the checkpoint fileName, creating it if there is none. An empty file starts a
+* new game. Otherwise it must hold a saved game, whose header is read so the world it
+* was played in can be loaded before checkpointAttach.
+****************************************************************************************/
+bool checkpointOpen(struct Checkpoint *checkpoint, const char *fileName)
+{
+	memset(checkpoint, 0, sizeof(struct Checkpoint));
+	checkpoint->fileName = fileName;
+	checkpoint->fd = open(fileName, O_RDWR | O_CREAT | O_APPEND, 0644);
+	if(checkpoint->fd < 0)
+	{
+		perror(fileName);
+		return false;
+	}
+
+	struct CheckpointHeader *header = &checkpoint->header;
+	ssize_t bytesRead = pread(checkpoint->fd, header, sizeof(struct CheckpointHeader), 0);
+	if(bytesRead == 0)
+		return true;
+	if(bytesRead != sizeof(struct CheckpointHeader) || memcmp(header->magic, CHECKPOINT_MAGIC, 8) != 0 ||
+	   header->version != CHECKPOINT_VERSION || header->source > CHECKPOINT_EMBEDDED ||
+	   header->directory[sizeof(header->directory) - 1] != '\0')
+	{
+		fprintf(stderr, "%s is not a checkpoint, remove it to start a new game\n", fileName);
+		close(checkpoint->fd);
+		checkpoint->fd = -1;
+		return false;
+	}
+	checkpoint->resuming = true;
+	return true;
+}
+
+/***************************************************************************************
+* Ties the checkpoint to the world about to be played, described by world. A new game
+* writes the header naming directoryName, or archive world archiveWorld when there is
+* no directory, or the compiled in world when there is neither. A saved game is checked
+* against the world and its steps read straight into path, nothing is replayed. The
+* game starts from currentRoom either way.
+****************************************************************************************/
+bool checkpointAttach(struct Checkpoint *checkpoint, const struct WorldHeader *world, const char *directoryName,
+                      uint64_t archiveWorld)
+{
+	struct CheckpointHeader *header = &checkpoint->header;
+	checkpoint->currentRoom = world->startRoom;
+	if(!checkpoint->resuming)
+	{
+		memcpy(header->magic, CHECKPOINT_MAGIC, 8);
+		header->version = CHECKPOINT_VERSION;
+		header->source = directoryName != NULL ? CHECKPOINT_DIRECTORY :
+		                 archiveWorld != 0 ? CHECKPOINT_ARCHIVE : CHECKPOINT_EMBEDDED;
+		if(directoryName != NULL)
+			snprintf(header->directory, sizeof(header->directory), "%s", directoryName);
+		header->archiveWorld = archiveWorld;
+		header->numRooms = world->numRooms;
+		header->numConnections = world->numConnections;
+		header->startRoom = world->startRoom;
+		header->endRoom = world->endRoom;
+		header->stringPoolSize = world->stringPoolSize;
+		if(write(checkpoint->fd, header, sizeof(struct CheckpointHeader)) != sizeof(struct CheckpointHeader))
+		{
+			perror(checkpoint->fileName);
+			return false;
+		}
+		return true;
+	}
+
+	if(header->numRooms != world->numRooms || header->numConnections != world->numConnections ||
+	   header->startRoom != world->startRoom || header->endRoom != world->endRoom ||
+	   header->stringPoolSize != world->stringPoolSize)
+	{
+		fprintf(stderr, "%s was saved in a different world\n", checkpoint->fileName);
+		return false;
+	}
+
+	uint64_t start = STATS_NOW();
+	uint32_t *steps = malloc(CHECKPOINT_READ_STEPS * sizeof(uint32_t));
+	if(steps == NULL)
+	{
+		perror("malloc");
+		return false;
+	}
+	off_t offset = sizeof(struct CheckpointHeader);
+	ssize_t bytesRead;
+	bool resumed = true;
+	do
+	{
+		bytesRead = pread(checkpoint->fd, steps, CHECKPOINT_READ_STEPS * sizeof(uint32_t), offset);
+		if(bytesRead < 0)
+		{
+			perror(checkpoint->fileName);
+			resumed = false;
+			break;
+		}
+		uint32_t numSteps = bytesRead / sizeof(uint32_t), i;
+		for(i = 0; i < numSteps && resumed; i++)
+		{
+			if(steps[i] >= world->numRooms)
+			{
+				fprintf(stderr, "%s is corrupt, step %" PRIu64 " is not a room\n", checkpoint->fileName,
+				        checkpoint->path.numSteps + 1);
+				resumed = false;
+			}
+			else if(!pathAppend(&checkpoint->path, steps[i]))
+			{
+				perror("malloc");
+				resumed = false;
+			}
+		}
+		offset += (off_t)numSteps * sizeof(uint32_t);
+	}
+	while(resumed && bytesRead == CHECKPOINT_READ_STEPS * sizeof(uint32_t));
+	free(steps);
+
+	// A save cut short by a crash is dropped, so the next move is appended whole
+	if(resumed && ftruncate(checkpoint->fd, offset) != 0)
+	{
+		perror(checkpoint->fileName);
+		resumed = false;
+	}
+	if(!resumed)
+	{
+		pathFree(&checkpoint->path);
+		return false;
+	}
+	if(checkpoint->path.numSteps > 0)
+		checkpoint->currentRoom = checkpoint->path.last->rooms[checkpoint->path.lastUsed - 1];
+	STATS_TIMER(TIMER_RESUME, start);
+	fprintf(stderr, "Resuming the game in %s after %" PRIu64 " steps\n", checkpoint->fileName, checkpoint->path.numSteps);
+	return true;
+}
+
+/***************************************************************************************
+* Saves a move to room. A save that fails is reported once and the game goes on, only
+* unsaved.
+****************************************************************************************/
+void checkpointMove(struct Checkpoint *checkpoint, uint32_t room)
+{
+	if(checkpoint->fd < 0 || checkpoint->failed)
+		return;
+	if(write(checkpoint->fd, &room, sizeof(uint32_t)) != sizeof(uint32_t))
+	{
+		perror(checkpoint->fileName);
+		checkpoint->failed = true;
+	}
+}
+
+/***************************************************************************************
+* Closes the checkpoint. A finished game has nothing left to resume, so its file goes.
+****************************************************************************************/
+void checkpointClose(struct Checkpoint *checkpoint, bool finished)
+{
+	if(checkpoint->fd < 0)
+		return;
+	close(checkpoint->fd);
+	checkpoint->fd = -1;
+	if(finished)
+		unlink(checkpoint->fileName);
+	pathFree(&checkpoint->path);
+}
+
+/***************************************************************************************
+* Makes an empty prompt cache for a world of numRooms, false if out of memory
+****************************************************************************************/
+bool promptCacheInit(struct PromptCache *cache, uint32_t numRooms)
+{
+	// calloc hands back untouched zero pages, so rooms never shown cost no memory
+	cache->prompts = calloc(numRooms, sizeof(const char*));
+	cache->lengths = calloc(numRooms, sizeof(uint32_t));
+	cache->chunks = NULL;
+	if(cache->prompts == NULL || cache->lengths == NULL)
+	{
+		perror("calloc");
+		promptCacheFree(cache);
+		return false;
+	}
+	return true;
+}
+
+/***************************************************************************************
+* Returns the prompt shown in room and sets length to its size, formatting it the
+* first time the room is shown. NULL if out of memory.
+****************************************************************************************/
+const char *roomPrompt(struct PromptCache *cache, const struct World *world, uint32_t room, uint32_t *length)
+{
+	if(cache->prompts[room] != NULL)
+	{
+		*length = cache->lengths[room];
+		return cache->prompts[room];
+	}
+
+	// Work out the size first so the prompt is written straight into a chunk
+	int numConnections = worldNumConnections(world, room);
+	size_t size = strlen("CURRENT LOCATION: \nPOSSIBLE CONNECTIONS: .\nWHERE TO? >") +
+	              strlen(worldRoomName(world, room)) + 2 * (numConnections - 1);
+	int x;
+	for(x = 0; x < numConnections; x++)
+		size += strlen(worldRoomName(world, worldConnection(world, room, x)));
+
+	struct PromptChunk *chunk = cache->chunks;
+	if(chunk == NULL || chunk->size - chunk->used < size + 1)
+	{
+		size_t chunkSize = size + 1 > PROMPT_CHUNK_SIZE ? size + 1 : PROMPT_CHUNK_SIZE;
+		chunk = malloc(sizeof(struct PromptChunk) + chunkSize);
+		if(chunk == NULL)
+			return NULL;
+		chunk->next = cache->chunks;
+		chunk->size = chunkSize;
+		chunk->used = 0;
+		cache->chunks = chunk;
+	}
+
+	char *prompt = chunk->text + chunk->used;
+	char *end = prompt + sprintf(prompt, "CURRENT LOCATION: %s\nPOSSIBLE CONNECTIONS: ", worldRoomName(world, room));
+	for(x = 0; x < numConnections - 1; x++)
+		end += sprintf(end, "%s, ", worldRoomName(world, worldConnection(world, room, x)));
+	end += sprintf(end, "%s.\nWHERE TO? >", worldRoomName(world, worldConnection(world, room, x)));
+
+	chunk->used += size + 1;
+	cache->prompts[room] = prompt;
+	cache->lengths[room] = size;
+	*length = size;
+	return prompt;
+}
+
+/***************************************************************************************
+* Frees every prompt
+****************************************************************************************/
+void promptCacheFree(struct PromptCache *cache)
+{
+	while(cache->chunks != NULL)
+	{
+		struct PromptChunk *next = cache->chunks->next;
+		free(cache->chunks);
+		cache->chunks = next;
+	}
+	free(cache->prompts);
+	free(cache->lengths);
+	cache->prompts = NULL;
+	cache->lengths = NULL;
+}
+
+/***************************************************************************************
+* Runs the game loop until the user reaches the END room, false if input ends first
+****************************************************************************************/
+bool playGame(const struct World *world)
+{
+	uint32_t currentRoom;		// Room number user is in
+	char userInput[INPUT_LINE_SIZE];	// First word of the line the user typed
+	bool played = true;
+	struct PathLog path = { NULL, NULL, 0, 0 };	// Rooms visited, counts steps of user
+
+	// Start where the world says to, or where a saved game left off
+	currentRoom = world->header->startRoom;
+	if(checkpoint.fd >= 0)
+	{
+		currentRoom = checkpoint.currentRoom;
+		path = checkpoint.path;
+		checkpoint.path = (struct PathLog){ NULL, NULL, 0, 0 };
+	}
+	logEvent(EVENT_START, 0, currentRoom, 0);
+
+	// Output of a turn is only sent when the prompt is, even to a terminal or pipe
+	setvbuf(stdout, NULL, _IOFBF, PROMPT_BUFFER_SIZE);
+
+	// Run game in while loop
+	while(currentRoom != world->header->endRoom)
+	{
+		// Location, connections and WHERE TO?, formatted once per room
+		uint32_t length;
+		const char *prompt = roomPrompt(&promptCache, world, currentRoom, &length);
+		if(prompt == NULL)
+		{
+			perror("malloc");
+			break;
+		}
+		fwrite(prompt, 1, length, stdout);
+		fflush(stdout);
+
+		// User interface and input
+		if(!readCommand(userInput))
+		{
+			// Input ended before END was found
+			printf("\n");
+			played = false;
+			break;
+		}
+		uint64_t start = STATS_NOW();
+		printf("\n");
+
+		if(strcmp(userInput, "time") == 0)
+		{
+			// Displays time kept by the time thread
+			readTime();
+			STATS_LATENCY(LATENCY_TIME, start);
+			logEvent(EVENT_TIME, 0, currentRoom, 0);
+		}
+		else if(strcmp(userInput, "hint") == 0)
+		{
+			char hint[80];
+			formatHint(world, currentRoom, hint);
+			printf("%s", hint);
+			STATS_LATENCY(LATENCY_HINT, start);
+			logEvent(EVENT_HINT, 0, currentRoom, 0);
+		}
+		else if(isCompletion(userInput))
+		{
+			// Lists the connections starting with what was typed before the ?
+			struct Matches matches;
+			char text[MATCH_TEXT_SIZE];
+			findMatches(world, currentRoom, userInput, &matches);
+			formatMatches(&matches, userInput, true, text);
+			printf("%s", text);
+			STATS_LATENCY(LATENCY_HINT, start);
+		}
+		else
+		{
+			// Search if room is one of the listed rooms, or the only one it starts
+			struct Matches matches;
+			uint32_t nextRoom = findMove(world, currentRoom, userInput, &matches);
+			if(nextRoom == MOVE_AMBIGUOUS)
+			{
+				char text[MATCH_TEXT_SIZE];
+				formatMatches(&matches, userInput, false, text);
+				printf("%s", text);
+				STATS_LATENCY(LATENCY_INVALID, start);
+				logEvent(EVENT_INVALID, 0, currentRoom, 0);
+			}
+			else if(nextRoom != WORLD_NO_ROOM)
+			{
+				// Move user to selected room
+				if(!pathAppend(&path, nextRoom))
+				{
+					perror("malloc");
+					played = false;
+					break;
+				}
+				checkpointMove(&checkpoint, nextRoom);
+				logEvent(EVENT_MOVE, 0, nextRoom, currentRoom);
+				currentRoom = nextRoom;
+				STATS_LATENCY(LATENCY_MOVE, start);
+			}
+			// If userInput does not match any room, output error
+			else
+			{
+				printf("HUH? I DON'T UNDERSTAND THAT ROOM. TRY AGAIN.\n");
+				STATS_LATENCY(LATENCY_INVALID, start);
+				logEvent(EVENT_INVALID, 0, currentRoom, 0);
+			}
+		}	
+	}
+	logEvent(played ? EVENT_END : EVENT_QUIT, 0, currentRoom, path.numSteps);
+	if(!played)
+	{
+		pathFree(&path);
+		return false;
+	}
+	// Output message when user has found room
+	printf("YOU HAVE FOUND THE END ROOM. CONGRATULATIONS!\n");
+	printf("YOU TOOK %" PRIu64 " STEPS. YOUR PATH TO VICTORY WAS:\n", path.numSteps);
+	// Prints list of rooms visited, straight from the log
+	struct PathChunk *chunk;
+	uint32_t i;
+	for(chunk = pathBegin(&path); chunk != NULL; chunk = chunk == path.last ? NULL : chunk->next)
+	{
+		for(i = 0; i < pathChunkUsed(&path, chunk); i++)
+			printf("%s\n", worldRoomName(world, chunk->rooms[i]));
+	}
+	printf("THE SHORTEST PATH WAS %u STEPS.\n", world->distances[world->header->startRoom]);
+	pathFree(&path);
+	return true;
+}
+
+/***************************************************************************************
+* Reads a line from the user and puts its first word in input, which holds
+* INPUT_LINE_SIZE characters. Blank lines are skipped, the same as scanf("%s") did. A
+* line too long for input leaves input empty, which matches nothing. False once input
+* ends.
+****************************************************************************************/
+bool readCommand(char *input)
+{
+	char line[INPUT_LINE_SIZE];
+	for(;;)
+	{
+		if(fgets(line, sizeof(line), stdin) == NULL)
+			return false;
+		size_t length = strlen(line);
+		if(length == sizeof(line) - 1 && line[length - 1] != '\n')
+		{
+			// No room name is that long, the rest of the line is thrown away
+			int c;
+			while((c = getchar()) != '\n' && c != EOF)
+				;
+			input[0] = '\0';
+			return true;
+		}
+		char *word = strtok(line, " \t\r\n");
+		if(word != NULL)
+		{
+			strcpy(input, word);
+			return true;
+		}
+	}
+}
+
+
+/***************************************************************************************
+* Writes the hint for room into hint, which holds 80 characters. Distances were worked
+* out when the world was built, so this only looks at room's connections.
+****************************************************************************************/
+void formatHint(const struct World *world, uint32_t room, char *hint)
+{
+	uint32_t nextRoom = worldNextStep(world, room);
+	if(nextRoom == WORLD_NO_ROOM)
+		snprintf(hint, 80, "NO ROOM FROM HERE LEADS TO THE END.\n\n");
+	else
+		snprintf(hint, 80, "HINT: GO TO %s. THE END IS %u STEPS AWAY.\n\n",
+		         worldRoomName(world, nextRoom), world->distances[room]);
+}
+
+/***************************************************************************************
+* Returns the connection of room the player meant by input: the one with exactly that
+* name, else the only one whose name starts with input ignoring case, else the one
+* named input ignoring case. WORLD_NO_ROOM if there is none, MOVE_AMBIGUOUS if input
+* could be more than one, and then matches says which.
+****************************************************************************************/
+uint32_t findMove(const struct World *world, uint32_t room, const char *input, struct Matches *matches)
+{
+	// Exact names are one index lookup, the trie is only for everything else
+	matches->count = 0;
+	uint32_t nextRoom = worldMoveTarget(world, room, input);
+	if(nextRoom != WORLD_NO_ROOM || input[0] == '\0')
+		return nextRoom;
+	findMatches(world, room, input, matches);
+	return pickMatch(matches, input);
+}
+
+/***************************************************************************************
+* Finds the connections of room whose names start with prefix ignoring case, building
+* nameMatcher first if this is the first time it is needed
+****************************************************************************************/
+void findMatches(const struct World *world, uint32_t room, const char *prefix, struct Matches *matches)
+{
+	matches->count = 0;
+	if(nameMatcher.nodes == NULL && !worldMatcherBuild(&nameMatcher, world))
+		return;
+	matches->count = worldMatchConnections(&nameMatcher, world, room, prefix, matches->rooms, MATCH_LIST_NAMES);
+	int i;
+	for(i = 0; i < matches->count && i < MATCH_LIST_NAMES; i++)
+		matches->names[i] = worldRoomName(world, matches->rooms[i]);
+}
+
+/***************************************************************************************
+* Same as findMatches for a lazy game, where only the current room's connections are
+* at hand. There are at most WORLD_MAX_CONNECTIONS of them, so they are just compared.
+****************************************************************************************/
+void findLazyMatches(const struct CachedRoom *current, const struct CachedRoom *connections,
+                     const char *prefix, struct Matches *matches)
+{
+	size_t length = strlen(prefix);
+	uint32_t x;
+	matches->count = 0;
+	for(x = 0; x < current->numConnections; x++)
+	{
+		if(strncasecmp(connections[x].name, prefix, length) == 0)
+		{
+			matches->rooms[matches->count] = connections[x].room;
+			matches->names[matches->count++] = connections[x].name;
+		}
+	}
+}
+
+/***************************************************************************************
+* Picks the room input meant out of matches, the same way as findMove
+****************************************************************************************/
+uint32_t pickMatch(const struct Matches *matches, const char *input)
+{
+	if(matches->count == 0)
+		return WORLD_NO_ROOM;
+	if(matches->count == 1)
+		return matches->rooms[0];
+
+	// r1 means R1 even when R10 is also a connection
+	size_t length = strlen(input);
+	int i;
+	for(i = 0; i < matches->count && i < MATCH_LIST_NAMES; i++)
+	{
+		if(strlen(matches->names[i]) == length)
+			return matches->rooms[i];
+	}
+	return MOVE_AMBIGUOUS;
+}
+
+/***************************************************************************************
+* Writes the message naming matches into text, which holds MATCH_TEXT_SIZE characters.
+* completing is true when the player asked with ?, false when a move was ambiguous.
+****************************************************************************************/
+void formatMatches(const struct Matches *matches, const char *input, bool completing, char *text)
+{
+	size_t length;
+	if(matches->count == 0)
+	{
+		snprintf(text, MATCH_TEXT_SIZE, "NO CONNECTION STARTS WITH %s.\n\n", input);
+		return;
+	}
+	if(completing)
+		length = snprintf(text, MATCH_TEXT_SIZE, "MATCHING CONNECTIONS: ");
+	else
+		length = snprintf(text, MATCH_TEXT_SIZE, "HUH? %s COULD BE ", input);
+
+	int i;
+	for(i = 0; i < matches->count && i < MATCH_LIST_NAMES && length < MATCH_TEXT_SIZE; i++)
+		length += snprintf(text + length, MATCH_TEXT_SIZE - length, "%s%s", i > 0 ? ", " : "", matches->names[i]);
+	if(length < MATCH_TEXT_SIZE && matches->count > MATCH_LIST_NAMES)
+		length += snprintf(text + length, MATCH_TEXT_SIZE - length, " AND %d MORE", matches->count - MATCH_LIST_NAMES);
+	if(length < MATCH_TEXT_SIZE)
+		snprintf(text + length, MATCH_TEXT_SIZE - length, completing ? ".\n\n" : ". TRY AGAIN.\n");
+}
+
+/***************************************************************************************
+* True if input ends with ?, which asks for the connections starting with the rest of
+* it. The ? is removed.
+****************************************************************************************/
+bool isCompletion(char *input)
+{
+	size_t length = strlen(input);
+	if(length == 0 || input[length - 1] != '?')
+		return false;
+	input[length - 1] = '\0';
+	return true;
+}
+
+/***************************************************************************************
+* Plays the same game as playGame with rooms read from world.bin in directoryName as
+* they are reached, holding at most cacheRooms of them. Time to the first prompt and
+* memory depend on the path taken, not on the size of the world.
+****************************************************************************************/
+bool playLazyGame(const char *directoryName, uint32_t cacheRooms)
+{
+	char fileName[300];
+	sprintf(fileName, "%s/%s", directoryName, WORLD_FILE_NAME);
+	if(access(fileName, F_OK) != 0)
+	{
+		fprintf(stderr, "%s has no %s, lazy loading needs buildrooms -f binary or both\n",
+		        directoryName, WORLD_FILE_NAME);
+		return false;
+	}
+	struct WorldCache cache;
+	if(!worldCacheOpen(&cache, fileName, cacheRooms))
+		return false;
+
+	struct CachedRoom current;
+	struct CachedRoom connections[WORLD_MAX_CONNECTIONS];
+	char userInput[INPUT_LINE_SIZE];	// First word of the line the user typed
+	struct PathLog path = { NULL, NULL, 0, 0 };	// Rooms visited, counts steps of user
+	uint32_t currentRoom = cache.header.startRoom;
+	bool played = true;
+	if(checkpoint.fd >= 0)
+	{
+		if(!checkpointAttach(&checkpoint, &cache.header, directoryName, 0))
+		{
+			worldCacheClose(&cache);
+			return false;
+		}
+		currentRoom = checkpoint.currentRoom;
+		path = checkpoint.path;
+		checkpoint.path = (struct PathLog){ NULL, NULL, 0, 0 };
+	}
+	setvbuf(stdout, NULL, _IOFBF, PROMPT_BUFFER_SIZE);
+	logEvent(EVENT_START, 0, currentRoom, 0);
+
+	while(currentRoom != cache.header.endRoom)
+	{
+		// Room and every room it lists are read before the prompt is shown
+		if(!readLazyRoom(&cache, currentRoom, &current, connections))
+		{
+			played = false;
+			break;
+		}
+		// Rooms come and go, so the prompt is not kept, but it still goes out in one write
+		char prompt[96 + (WORLD_MAX_CONNECTIONS + 1) * WORLD_NAME_SIZE];
+		int length = sprintf(prompt, "CURRENT LOCATION: %s\nPOSSIBLE CONNECTIONS: ", current.name);
+		uint32_t x;
+		for(x = 0; x < current.numConnections - 1; x++)
+			length += sprintf(prompt + length, "%s, ", connections[x].name);
+		length += sprintf(prompt + length, "%s.\nWHERE TO? >", connections[x].name);
+		fwrite(prompt, 1, length, stdout);
+		fflush(stdout);
+
+		if(!readCommand(userInput))
+		{
+			// Input ended before END was found
+			printf("\n");
+			played = false;
+			break;
+		}
+		uint64_t start = STATS_NOW();
+		printf("\n");
+
+		if(strcmp(userInput, "time") == 0)
+		{
+			readTime();
+			STATS_LATENCY(LATENCY_TIME, start);
+			logEvent(EVENT_TIME, 0, currentRoom, 0);
+		}
+		else if(strcmp(userInput, "hint") == 0)
+		{
+			// Same hint as formatHint, from the distances read with the rooms
+			for(x = 0; x < current.numConnections && connections[x].distance + 1 != current.distance; x++)
+				;
+			if(current.distance == WORLD_UNREACHABLE || x == current.numConnections)
+				printf("NO ROOM FROM HERE LEADS TO THE END.\n\n");
+			else
+				printf("HINT: GO TO %s. THE END IS %u STEPS AWAY.\n\n", connections[x].name, current.distance);
+			STATS_LATENCY(LATENCY_HINT, start);
+			logEvent(EVENT_HINT, 0, currentRoom, 0);
+		}
+		else if(isCompletion(userInput))
+		{
+			struct Matches matches;
+			char text[MATCH_TEXT_SIZE];
+			findLazyMatches(&current, connections, userInput, &matches);
+			formatMatches(&matches, userInput, true, text);
+			printf("%s", text);
+			STATS_LATENCY(LATENCY_HINT, start);
+		}
+		else
+		{
+			// Same check as findMove
+			struct Matches matches = { .count = 0 };
+			uint32_t nextRoom = WORLD_NO_ROOM;
+			for(x = 0; x < current.numConnections && strcmp(userInput, connections[x].name) != 0; x++)
+				;
+			if(x < current.numConnections)
+				nextRoom = connections[x].room;
+			else if(userInput[0] != '\0')
+			{
+				findLazyMatches(&current, connections, userInput, &matches);
+				nextRoom = pickMatch(&matches, userInput);
+			}
+
+			if(nextRoom == MOVE_AMBIGUOUS)
+			{
+				char text[MATCH_TEXT_SIZE];
+				formatMatches(&matches, userInput, false, text);
+				printf("%s", text);
+				STATS_LATENCY(LATENCY_INVALID, start);
+				logEvent(EVENT_INVALID, 0, currentRoom, 0);
+			}
+			else if(nextRoom != WORLD_NO_ROOM)
+			{
+				if(!pathAppend(&path, nextRoom))
+				{
+					perror("malloc");
+					played = false;
+					break;
+				}
+				checkpointMove(&checkpoint, nextRoom);
+				logEvent(EVENT_MOVE, 0, nextRoom, currentRoom);
+				currentRoom = nextRoom;
+				STATS_LATENCY(LATENCY_MOVE, start);
+			}
+			else
+			{
+				printf("HUH? I DON'T UNDERSTAND THAT ROOM. TRY AGAIN.\n");
+				STATS_LATENCY(LATENCY_INVALID, start);
+				logEvent(EVENT_INVALID, 0, currentRoom, 0);
+			}
+		}
+	}
+	logEvent(played ? EVENT_END : EVENT_QUIT, 0, currentRoom, path.numSteps);
+
+	if(played)
+	{
+		printf("YOU HAVE FOUND THE END ROOM. CONGRATULATIONS!\n");
+		printf("YOU TOOK %" PRIu64 " STEPS. YOUR PATH TO VICTORY WAS:\n", path.numSteps);
+		// Rooms visited long ago may have been dropped, they are read again
+		struct PathChunk *chunk;
+		uint32_t i;
+		for(chunk = pathBegin(&path); chunk != NULL && played; chunk = chunk == path.last ? NULL : chunk->next)
+		{
+			for(i = 0; i < pathChunkUsed(&path, chunk) && played; i++)
+			{
+				played = worldCacheRoom(&cache, chunk->rooms[i], &current);
+				if(played)
+					printf("%s\n", current.name);
+			}
+		}
+		if(played)
+			played = worldCacheRoom(&cache, cache.header.startRoom, &current);
+		if(played)
+			printf("THE SHORTEST PATH WAS %u STEPS.\n", current.distance);
+	}
+	pathFree(&path);
+	worldCacheClose(&cache);
+	return played;
+}
+
+/***************************************************************************************
+* Reads room into current and each room it connects to into connections, false if
+* any of them could not be read
+****************************************************************************************/
+bool readLazyRoom(struct WorldCache *cache, uint32_t room, struct CachedRoom *current,
+                  struct CachedRoom *connections)
+{
+	if(!worldCacheRoom(cache, room, current) || current->numConnections == 0)
+	{
+		fprintf(stderr, "Room %u could not be read\n", room);
+		return false;
+	}
+	uint32_t x;
+	for(x = 0; x < current->numConnections; x++)
+	{
+		if(!worldCacheRoom(cache, current->connections[x], &connections[x]))
+		{
+			fprintf(stderr, "Room %u could not be read\n", current->connections[x]);
+			return false;
+		}
+	}
+	return true;
+}
+
+/***************************************************************************************
+* Returns next word or newline from batch input. Words are terminated in place and
+* stay valid until the next call. Words longer than the buffer are cut short.
+****************************************************************************************/
+enum BatchToken nextBatchToken(struct BatchInput *input, char **word)
+{
+	if(input->pendingNewline)
+	{
+		input->pendingNewline = false;
+		return TOKEN_NEWLINE;
+	}
+
+	for(;;)
+	{
+		// Skip blanks, newlines end the session
+		while(input->next < input->end && isspace((unsigned char)input->buffer[input->next]))
+		{
+			if(input->buffer[input->next++] == '\n')
+				return TOKEN_NEWLINE;
+		}
+
+		// Find end of word
+		size_t start = input->next;
+		size_t stop = start;
+		while(stop < input->end && !isspace((unsigned char)input->buffer[stop]))
+			stop++;
+
+		// Word is complete if a blank follows, input is done, or buffer is full
+		if(stop < input->end || (input->eof && stop > start) ||
+		   (start == 0 && stop == BATCH_BUFFER_SIZE))
+		{
+			if(stop < input->end && input->buffer[stop] == '\n')
+				input->pendingNewline = true;
+			input->buffer[stop] = '\0';
+			input->next = stop < input->end ? stop + 1 : stop;
+			*word = input->buffer + start;
+			return TOKEN_WORD;
+		}
+		if(input->eof)
+			return TOKEN_EOF;
+
+		// Move partial word to front and fill the rest of the buffer
+		memmove(input->buffer, input->buffer + start, stop - start);
+		input->end = stop - start;
+		input->next = 0;
+		ssize_t bytesRead = read(input->fd, input->buffer + input->end, BATCH_BUFFER_SIZE - input->end);
+		if(bytesRead <= 0)
+		{
+			if(bytesRead < 0)
+				perror("read");
+			input->eof = true;
+		}
+		else
+			input->end += bytesRead;
+	}
+}
+
+/***************************************************************************************
+* Replays sessions from a file without prompts. Every line is one session of moves
+* starting in the START room. Moves after the END room is reached are ignored, and so
+* are time and hint. Prints one line per session: steps, invalid moves, whether END
+* was reached, and the path.
+****************************************************************************************/
+bool runBatch(const struct World *world, const char *fileName)
+{
+	struct BatchInput input;
+	memset(&input, 0, sizeof(struct BatchInput));
+	input.fd = strcmp(fileName, "-") == 0 ? STDIN_FILENO : open(fileName, O_RDONLY);
+	if(input.fd < 0)
+	{
+		perror(fileName);
+		return false;
+	}
+	input.buffer = malloc(BATCH_BUFFER_SIZE + 1);
+	if(input.buffer == NULL)
+	{
+		perror("malloc");
+		if(input.fd != STDIN_FILENO)
+			close(input.fd);
+		return false;
+	}
+
+	// Path is kept for the whole session and its chunks reused for the next one
+	struct PathLog path = { NULL, NULL, 0, 0 };
+
+	// Pipes get full buffers instead of a write per line
+	setvbuf(stdout, NULL, _IOFBF, BATCH_BUFFER_SIZE);
+
+	struct timespec startTime, endTime;
+	clock_gettime(CLOCK_MONOTONIC, &startTime);
+
+	uint64_t numSessions = 0, totalMoves = 0;
+	uint32_t currentRoom = world->header->startRoom;
+	uint64_t numInvalid = 0;
+	bool inSession = false;
+
+	enum BatchToken token;
+	char *word;
+	do
+	{
+		token = nextBatchToken(&input, &word);
+		if(token == TOKEN_WORD)
+		{
+			inSession = true;
+			totalMoves++;
+			if(currentRoom == world->header->endRoom || strcmp(word, "time") == 0 ||
+			   strcmp(word, "hint") == 0 || word[strlen(word) - 1] == '?')
+				continue;
+
+			// Same check as playGame, a name that could be more than one room is invalid
+			struct Matches matches;
+			uint32_t nextRoom = findMove(world, currentRoom, word, &matches);
+			if(nextRoom == WORLD_NO_ROOM || nextRoom == MOVE_AMBIGUOUS)
+			{
+				numInvalid++;
+				continue;
+			}
+
+			if(!pathAppend(&path, nextRoom))
+			{
+				perror("malloc");
+				break;
+			}
+			currentRoom = nextRoom;
+		}
+		else if(inSession)
+		{
+			// Newline or end of input finishes the session
+			printf("%" PRIu64 " %" PRIu64 " %s", path.numSteps, numInvalid,
+			       currentRoom == world->header->endRoom ? "END" : "INCOMPLETE");
+			struct PathChunk *chunk;
+			uint32_t i;
+			for(chunk = pathBegin(&path); chunk != NULL; chunk = chunk == path.last ? NULL : chunk->next)
+			{
+				for(i = 0; i < pathChunkUsed(&path, chunk); i++)
+				{
+					putchar(' ');
+					fputs(worldRoomName(world, chunk->rooms[i]), stdout);
+				}
+			}
+			putchar('\n');
+
+			numSessions++;
+			currentRoom = world->header->startRoom;
+			pathClear(&path);
+			numInvalid = 0;
+			inSession = false;
+		}
+	}
+	while(token != TOKEN_EOF);
+
+	fflush(stdout);
+	clock_gettime(CLOCK_MONOTONIC, &endTime);
+	double seconds = (endTime.tv_sec - startTime.tv_sec) + (endTime.tv_nsec - startTime.tv_nsec) / 1e9;
+	fprintf(stderr, "%" PRIu64 " sessions, %" PRIu64 " moves in %.3f seconds, %.0f moves per second\n",
+	        numSessions, totalMoves, seconds, seconds > 0 ? totalMoves / seconds : 0.0);
+	fprintf(stderr, "shortest path %u steps", world->distances[world->header->startRoom]);
+	if(world->header->diameter > 0)
+		fprintf(stderr, ", diameter %u%s", world->header->diameter, world->header->diameterExact ? "" : " or more");
+	fprintf(stderr, "\n");
+
+	if(input.fd != STDIN_FILENO)
+		close(input.fd);
+	free(input.buffer);
+	pathFree(&path);
+	return token == TOKEN_EOF;
+}
+
+/***************************************************************************************
+* True if every room a walk from START can reach has a path to END, so every walk
+* ends. Rooms with no connections have no path, so walks never need to leave one.
+****************************************************************************************/
+bool walksCanEnd(const struct World *world)
+{
+	uint32_t numRooms = world->header->numRooms;
+	uint32_t *queue = malloc(sizeof(uint32_t) * numRooms);
+	uint8_t *seen = calloc(numRooms, 1);
+	if(queue == NULL || seen == NULL)
+	{
+		perror("malloc");
+		free(queue);
+		free(seen);
+		return false;
+	}
+
+	uint32_t head = 0, tail = 0, i;
+	bool canEnd = true;
+	queue[tail++] = world->header->startRoom;
+	seen[world->header->startRoom] = 1;
+	while(head < tail && canEnd)
+	{
+		uint32_t room = queue[head++];
+		canEnd = world->distances[room] != WORLD_UNREACHABLE;
+		// Walks stop at END, what lies past it does not matter
+		if(room == world->header->endRoom)
+			continue;
+		for(i = world->offsets[room]; i < world->offsets[room + 1]; i++)
+		{
+			if(!seen[world->targets[i]])
+			{
+				seen[world->targets[i]] = 1;
+				queue[tail++] = world->targets[i];
+			}
+		}
+	}
+	free(queue);
+	free(seen);
+	return canEnd;
+}
+
+/***************************************************************************************
+* Returns next 32 random bits of a walk thread, xorshift64* like buildrooms
+****************************************************************************************/
+uint32_t walkRandom(uint64_t *state)
+{
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return (*state * 0x2545F4914F6CDD1Dull) >> 32;
+}
+
+/***************************************************************************************
+* Returns histogram bucket of a walk of steps. Short walks get a bucket each, longer
+* ones are off by at most 1/64 from the bucket they land in.
+****************************************************************************************/
+int walkBucket(uint64_t steps)
+{
+	if(steps < WALK_EXACT_STEPS)
+		return steps;
+	int power = 63 - __builtin_clzll(steps);
+	return WALK_EXACT_STEPS + (power - 10) * WALK_SUB_BUCKETS + ((steps >> (power - 6)) & (WALK_SUB_BUCKETS - 1));
+}
+
+/***************************************************************************************
+* Returns fewest steps that land in bucket
+****************************************************************************************/
+uint64_t walkBucketLow(int bucket)
+{
+	if(bucket < WALK_EXACT_STEPS)
+		return bucket;
+	bucket -= WALK_EXACT_STEPS;
+	return (uint64_t)(WALK_SUB_BUCKETS + bucket % WALK_SUB_BUCKETS) << (bucket / WALK_SUB_BUCKETS + 4);
+}
+
+/***************************************************************************************
+* Returns most steps in the bucket holding the given fraction of numWalks walks
+****************************************************************************************/
+uint64_t walkPercentile(const uint64_t *histogram, uint64_t numWalks, double fraction)
+{
+	uint64_t wanted = fraction * numWalks, seen = 0;
+	int bucket;
+	if(wanted < 1)
+		wanted = 1;
+	for(bucket = 0; bucket < WALK_BUCKETS - 1; bucket++)
+	{
+		seen += histogram[bucket];
+		if(seen >= wanted)
+			break;
+	}
+	return bucket < WALK_EXACT_STEPS ? (uint64_t)bucket : walkBucketLow(bucket + 1) - 1;
+}
+
+/***************************************************************************************
+* Walk thread, runs job's walks WALK_BATCH at a time. Each walker takes one random
+* step in turn, so the memory reads of different walkers overlap instead of every
+* step waiting on the one before it.
+****************************************************************************************/
+void *runWalkJob(void *arguments)
+{
+	struct WalkJob *job = arguments;
+	const struct World *world = job->world;
+	uint32_t startRoom = world->header->startRoom, endRoom = world->header->endRoom;
+	uint32_t rooms[WALK_BATCH];
+	uint64_t steps[WALK_BATCH];
+	uint64_t random = job->random;
+
+	uint32_t active = job->numWalks < WALK_BATCH ? job->numWalks : WALK_BATCH, i;
+	uint64_t walksStarted = active;
+	for(i = 0; i < active; i++)
+	{
+		rooms[i] = startRoom;
+		steps[i] = 0;
+	}
+
+	while(active > 0)
+	{
+		for(i = 0; i < active; )
+		{
+			uint32_t room = rooms[i];
+			uint32_t pick = ((uint64_t)walkRandom(&random) * worldNumConnections(world, room)) >> 32;
+			room = worldConnection(world, room, pick);
+			steps[i]++;
+			if(room != endRoom)
+			{
+				// Needed again when this walker's turn comes round
+				__builtin_prefetch(&world->offsets[room]);
+				rooms[i++] = room;
+				continue;
+			}
+
+			job->histogram[walkBucket(steps[i])]++;
+			job->totalSteps += steps[i];
+			if(steps[i] < job->shortestWalk)
+				job->shortestWalk = steps[i];
+			if(steps[i] > job->longestWalk)
+				job->longestWalk = steps[i];
+
+			// Walker starts the next walk, or the last walker takes its place
+			if(walksStarted < job->numWalks)
+			{
+				walksStarted++;
+				rooms[i] = startRoom;
+				steps[i++] = 0;
+			}
+			else
+			{
+				active--;
+				rooms[i] = rooms[active];
+				steps[i] = steps[active];
+			}
+		}
+	}
+	job->random = random;
+	return NULL;
+}
+
+/***************************************************************************************
+* Runs numWalks random walks from START to END on numThreads threads and prints the
+* distribution of their lengths, so worlds can be ranked by how hard they are to
+* finish without hints. False if some walk could never end.
+****************************************************************************************/
+bool runWalks(const struct World *world, uint64_t numWalks, int numThreads, uint64_t seed)
+{
+	if(!walksCanEnd(world))
+	{
+		fprintf(stderr, "Some rooms reachable from START have no path to END, walks would not end\n");
+		return false;
+	}
+	if(numThreads < 1)
+		numThreads = 1;
+	if(numThreads > WALK_MAX_THREADS)
+		numThreads = WALK_MAX_THREADS;
+	if((uint64_t)numThreads > numWalks)
+		numThreads = numWalks;
+	struct WalkJob *jobs = calloc(numThreads, sizeof(struct WalkJob));
+	if(jobs == NULL)
+	{
+		perror("malloc");
+		return false;
+	}
+
+	struct timespec startTime, endTime;
+	clock_gettime(CLOCK_MONOTONIC, &startTime);
+
+	int x, bucket;
+	for(x = 0; x < numThreads; x++)
+	{
+		jobs[x].world = world;
+		jobs[x].numWalks = numWalks / numThreads + ((uint64_t)x < numWalks % numThreads);
+		jobs[x].shortestWalk = UINT64_MAX;
+
+		// splitmix64 of seed and thread number, like buildrooms seeds its streams
+		uint64_t z = seed + (x + 1) * 0x9E3779B97F4A7C15ull;
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+		z = z ^ (z >> 31);
+		jobs[x].random = z != 0 ? z : 0x9E3779B97F4A7C15ull;
+	}
+
+	// Calling thread takes the first job, and any job a thread failed to take
+	pthread_t threads[WALK_MAX_THREADS];
+	bool started[WALK_MAX_THREADS] = { false };
+	for(x = 1; x < numThreads; x++)
+		started[x] = pthread_create(&threads[x], NULL, runWalkJob, &jobs[x]) == 0;
+	for(x = 0; x < numThreads; x++)
+	{
+		if(x == 0 || !started[x])
+			runWalkJob(&jobs[x]);
+	}
+	for(x = 1; x < numThreads; x++)
+	{
+		if(started[x])
+			pthread_join(threads[x], NULL);
+	}
+
+	// Everything is added into the first job
+	struct WalkJob *total = &jobs[0];
+	for(x = 1; x < numThreads; x++)
+	{
+		total->totalSteps += jobs[x].totalSteps;
+		if(jobs[x].shortestWalk < total->shortestWalk)
+			total->shortestWalk = jobs[x].shortestWalk;
+		if(jobs[x].longestWalk > total->longestWalk)
+			total->longestWalk = jobs[x].longestWalk;
+		for(bucket = 0; bucket < WALK_BUCKETS; bucket++)
+			total->histogram[bucket] += jobs[x].histogram[bucket];
+	}
+	clock_gettime(CLOCK_MONOTONIC, &endTime);
+	double seconds = (endTime.tv_sec - startTime.tv_sec) + (endTime.tv_nsec - startTime.tv_nsec) / 1e9;
+
+	printf("%" PRIu64 " walks from %s to %s, shortest path %u steps\n", numWalks,
+	       worldRoomName(world, world->header->startRoom), worldRoomName(world, world->header->endRoom),
+	       world->distances[world->header->startRoom]);
+	printf("steps: mean %.2f, min %" PRIu64 ", max %" PRIu64 "\n", (double)total->totalSteps / numWalks,
+	       total->shortestWalk, total->longestWalk);
+	printf("percentiles: p50 %" PRIu64 ", p90 %" PRIu64 ", p99 %" PRIu64 ", p99.9 %" PRIu64 "\n",
+	       walkPercentile(total->histogram, numWalks, 0.5), walkPercentile(total->histogram, numWalks, 0.9),
+	       walkPercentile(total->histogram, numWalks, 0.99), walkPercentile(total->histogram, numWalks, 0.999));
+
+	// One line per power of two of steps
+	printf("steps                      walks\n");
+	uint64_t rowWalks = 0;
+	int row = 0;
+	for(bucket = 1; bucket < WALK_BUCKETS; bucket++)
+	{
+		int bucketRow = 63 - __builtin_clzll(walkBucketLow(bucket));
+		if(bucketRow != row)
+		{
+			if(rowWalks > 0)
+				printf("  %9" PRIu64 "-%-9" PRIu64 " %12" PRIu64 " %6.2f%%\n", (uint64_t)1 << row,
+				       ((uint64_t)2 << row) - 1, rowWalks, 100.0 * rowWalks / numWalks);
+			rowWalks = 0;
+			row = bucketRow;
+		}
+		rowWalks += total->histogram[bucket];
+	}
+	if(rowWalks > 0)
+		printf("  %9" PRIu64 "-%-9" PRIu64 " %12" PRIu64 " %6.2f%%\n", (uint64_t)1 << row,
+		       ((uint64_t)2 << row) - 1, rowWalks, 100.0 * rowWalks / numWalks);
+
+	fprintf(stderr, "%d threads, %" PRIu64 " steps in %.3f seconds, %.0f steps per second\n", numThreads,
+	        total->totalSteps, seconds, seconds > 0 ? total->totalSteps / seconds : 0.0);
+	free(jobs);
+	return true;
+}
+
+/***************************************************************************************
+* Signal handler that makes runServer return
+****************************************************************************************/
+void stopServer(int signalNumber)
+{
+	(void)signalNumber;
+	serverRunning = 0;
+}
+
+/***************************************************************************************
+* Formats text onto the end of a session's output. A player that never reads would
+* make the output grow forever, so past SESSION_OUTPUT_LIMIT the session is dropped.
+* False if the text was not queued.
+****************************************************************************************/
+bool sendToSession(struct Session *session, const char *format, ...)
+{
+	va_list arguments;
+	for(;;)
+	{
+		size_t space = session->outputCapacity - session->outputLength;
+		va_start(arguments, format);
+		int length = vsnprintf(session->output + session->outputLength, space, format, arguments);
+		va_end(arguments);
+		if(length < 0)
+			return false;
+		if((size_t)length < space)
+		{
+			session->outputLength += length;
+			return true;
+		}
+
+		// Not enough space, grow and format again
+		if(session->outputLength + length >= SESSION_OUTPUT_LIMIT)
+		{
+			session->dropped = session->closing = true;
+			return false;
+		}
+		size_t capacity = session->outputCapacity * 2;
+		while(capacity - session->outputLength <= (size_t)length)
+			capacity *= 2;
+		char *grown = realloc(session->output, capacity);
+		if(grown == NULL)
+		{
+			session->dropped = session->closing = true;
+			return false;
+		}
+		session->output = grown;
+		session->outputCapacity = capacity;
+	}
+}
+
+/***************************************************************************************
+* Sends as much waiting output as the socket takes, false if the player is gone
+****************************************************************************************/
+bool flushSession(struct Session *session)
+{
+	while(session->outputSent < session->outputLength)
+	{
+		ssize_t sent = send(session->fd, session->output + session->outputSent,
+		                    session->outputLength - session->outputSent, MSG_NOSIGNAL);
+		if(sent < 0)
+			return errno == EAGAIN || errno == EWOULDBLOCK;
+		session->outputSent += sent;
+	}
+	session->outputSent = 0;
+	session->outputLength = 0;
+	return true;
+}
+
+/***************************************************************************************
+* Queues the same prompt playGame prints
+****************************************************************************************/
+void sendPrompt(const struct World *world, struct Session *session)
+{
+	uint32_t length;
+	const char *prompt = roomPrompt(&promptCache, world, session->currentRoom, &length);
+	if(prompt == NULL)
+	{
+		session->dropped = session->closing = true;
+		return;
+	}
+	sendToSession(session, "%.*s", (int)length, prompt);
+}
+
+/***************************************************************************************
+* Handles one line from a player the same way playGame handles one readCommand
+****************************************************************************************/
+void handleLine(const struct World *world, struct Session *session, char *line)
+{
+	// Only the first word counts, like readCommand
+	char *userInput = strtok(line, " \t\r");
+	if(userInput == NULL)
+		return;
+	uint64_t start = STATS_NOW();
+	sendToSession(session, "\n");
+
+	if(strcmp(userInput, "time") == 0)
+	{
+		char timeString[80];
+		getTime(timeString);
+		sendToSession(session, "%s\n\n\n", timeString);
+		sendPrompt(world, session);
+		STATS_LATENCY(LATENCY_TIME, start);
+		logEvent(EVENT_TIME, session->id, session->currentRoom, 0);
+		return;
+	}
+
+	if(strcmp(userInput, "hint") == 0)
+	{
+		char hint[80];
+		formatHint(world, session->currentRoom, hint);
+		sendToSession(session, "%s", hint);
+		sendPrompt(world, session);
+		STATS_LATENCY(LATENCY_HINT, start);
+		logEvent(EVENT_HINT, session->id, session->currentRoom, 0);
+		return;
+	}
+
+	if(isCompletion(userInput))
+	{
+		struct Matches matches;
+		char text[MATCH_TEXT_SIZE];
+		findMatches(world, session->currentRoom, userInput, &matches);
+		formatMatches(&matches, userInput, true, text);
+		sendToSession(session, "%s", text);
+		sendPrompt(world, session);
+		STATS_LATENCY(LATENCY_HINT, start);
+		return;
+	}
+
+	// Same check as playGame
+	struct Matches matches;
+	uint32_t nextRoom = findMove(world, session->currentRoom, userInput, &matches);
+	if(nextRoom == MOVE_AMBIGUOUS)
+	{
+		char text[MATCH_TEXT_SIZE];
+		formatMatches(&matches, userInput, false, text);
+		sendToSession(session, "%s", text);
+		sendPrompt(world, session);
+		STATS_LATENCY(LATENCY_INVALID, start);
+		logEvent(EVENT_INVALID, session->id, session->currentRoom, 0);
+		return;
+	}
+	if(nextRoom == WORLD_NO_ROOM)
+	{
+		sendToSession(session, "HUH? I DON'T UNDERSTAND THAT ROOM. TRY AGAIN.\n");
+		sendPrompt(world, session);
+		STATS_LATENCY(LATENCY_INVALID, start);
+		logEvent(EVENT_INVALID, session->id, session->currentRoom, 0);
+		return;
+	}
+
+	if(!pathAppend(&session->path, nextRoom))
+	{
+		session->dropped = session->closing = true;
+		return;
+	}
+	logEvent(EVENT_MOVE, session->id, nextRoom, session->currentRoom);
+	session->currentRoom = nextRoom;
+
+	if(nextRoom != world->header->endRoom)
+	{
+		sendPrompt(world, session);
+		STATS_LATENCY(LATENCY_MOVE, start);
+		return;
+	}
+	STATS_LATENCY(LATENCY_MOVE, start);
+	logEvent(EVENT_END, session->id, nextRoom, session->path.numSteps);
+	session->foundEnd = true;
+
+	// Same ending as playGame, then hang up
+	sendToSession(session, "YOU HAVE FOUND THE END ROOM. CONGRATULATIONS!\n");
+	sendToSession(session, "YOU TOOK %" PRIu64 " STEPS. YOUR PATH TO VICTORY WAS:\n", session->path.numSteps);
+	session->sendChunk = pathBegin(&session->path);
+	session->sendIndex = 0;
+	session->sendingPath = true;
+	session->closing = true;
+	queuePath(world, session);
+}
+
+/***************************************************************************************
+* Queues the next part of the winning path. Long paths go out a piece at a time as
+* the player reads them, so they never hit SESSION_OUTPUT_LIMIT.
+****************************************************************************************/
+void queuePath(const struct World *world, struct Session *session)
+{
+	const struct PathLog *path = &session->path;
+	while(session->sendChunk != NULL && session->outputLength < SESSION_OUTPUT_LIMIT / 2)
+	{
+		if(session->sendIndex == pathChunkUsed(path, session->sendChunk))
+		{
+			session->sendChunk = session->sendChunk == path->last ? NULL : session->sendChunk->next;
+			session->sendIndex = 0;
+			continue;
+		}
+		sendToSession(session, "%s\n", worldRoomName(world, session->sendChunk->rooms[session->sendIndex++]));
+	}
+	if(session->sendChunk == NULL)
+	{
+		sendToSession(session, "THE SHORTEST PATH WAS %u STEPS.\n", world->distances[world->header->startRoom]);
+		session->sendingPath = false;
+	}
+}
+
+/***************************************************************************************
+* Reads what the player sent and handles every complete line, false on hang up. A
+* player that sends faster than it reads is not read from until its output drains,
+* so lines are only handled while output is under half of SESSION_OUTPUT_LIMIT.
+****************************************************************************************/
+bool readSession(const struct World *world, struct Session *session)
+{
+	session->inputBlocked = false;
+	for(;;)
+	{
+		while(session->receivedNext < session->receivedEnd && !session->closing)
+		{
+			if(session->outputLength >= SESSION_OUTPUT_LIMIT / 2)
+			{
+				session->inputBlocked = true;
+				return true;
+			}
+
+			char c = session->received[session->receivedNext++];
+			if(c == '\n')
+			{
+				session->input[session->inputLength] = '\0';
+				if(session->discarding)
+				{
+					// No room name is that long
+					sendToSession(session, "\nHUH? I DON'T UNDERSTAND THAT ROOM. TRY AGAIN.\n");
+					sendPrompt(world, session);
+					logEvent(EVENT_INVALID, session->id, session->currentRoom, 0);
+				}
+				else
+					handleLine(world, session, session->input);
+				session->inputLength = 0;
+				session->discarding = false;
+			}
+			else if(session->inputLength < INPUT_LINE_SIZE - 1)
+				session->input[session->inputLength++] = c;
+			else
+				session->discarding = true;
+		}
+		if(session->closing)
+			return true;
+
+		ssize_t bytesRead = recv(session->fd, session->received, sizeof(session->received), 0);
+		if(bytesRead == 0)
+			return false;
+		if(bytesRead < 0)
+			return errno == EAGAIN || errno == EWOULDBLOCK;
+		session->receivedNext = 0;
+		session->receivedEnd = bytesRead;
+	}
+}
+
+/***************************************************************************************
+* Hangs up on a player and frees the session
+****************************************************************************************/
+void closeSession(int epollFd, struct Session *session)
+{
+	if(!session->foundEnd)
+		logEvent(EVENT_QUIT, session->id, session->currentRoom, session->path.numSteps);
+	if(session->previous != NULL)
+		session->previous->next = session->next;
+	else
+		openSessions = session->next;
+	if(session->next != NULL)
+		session->next->previous = session->previous;
+
+	epoll_ctl(epollFd, EPOLL_CTL_DEL, session->fd, NULL);
+	close(session->fd);
+	pathFree(&session->path);
+	free(session->output);
+	free(session);
+}
+
+/***************************************************************************************
+* Serves many players at once on a Unix domain socket from one epoll loop. Each
+* connection is one game, played with the same lines as the console game.
+****************************************************************************************/
+bool runServer(const struct World *world, const char *socketPath)
+{
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if(strlen(socketPath) >= sizeof(address.sun_path))
+	{
+		fprintf(stderr, "Socket path too long: %s\n", socketPath);
+		return false;
+	}
+	strcpy(address.sun_path, socketPath);
+
+	int listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+	unlink(socketPath);
+	if(listenFd < 0 || bind(listenFd, (struct sockaddr*)&address, sizeof(address)) < 0 ||
+	   listen(listenFd, SOMAXCONN) < 0)
+	{
+		perror(socketPath);
+		if(listenFd >= 0)
+			close(listenFd);
+		return false;
+	}
+
+	int epollFd = epoll_create1(0);
+	struct epoll_event event = { .events = EPOLLIN, .data.ptr = NULL };	// NULL marks listener
+	if(epollFd < 0 || epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event) < 0)
+	{
+		perror("epoll");
+		close(listenFd);
+		return false;
+	}
+
+	// Ctrl-C or kill shuts down cleanly
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = stopServer;
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+
+	// Built now so no player waits for it in the middle of a game
+	if(!worldMatcherBuild(&nameMatcher, world))
+	{
+		close(epollFd);
+		close(listenFd);
+		return false;
+	}
+
+	struct epoll_event events[SERVER_MAX_EVENTS];
+	uint32_t numSessions = 0;
+	while(serverRunning)
+	{
+		int numEvents = epoll_wait(epollFd, events, SERVER_MAX_EVENTS, -1);
+		if(numEvents < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			perror("epoll_wait");
+			break;
+		}
+
+		int x;
+		for(x = 0; x < numEvents; x++)
+		{
+			struct Session *session = events[x].data.ptr;
+
+			// New players, start each one in the START room
+			if(session == NULL)
+			{
+				int fd;
+				while((fd = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK)) >= 0)
+				{
+					session = calloc(1, sizeof(struct Session));
+					if(session != NULL)
+						session->output = malloc(session->outputCapacity = 256);
+					if(session == NULL || session->output == NULL)
+					{
+						free(session);
+						close(fd);
+						continue;
+					}
+					session->fd = fd;
+					session->id = ++numSessions;
+					session->currentRoom = world->header->startRoom;
+					logEvent(EVENT_START, session->id, session->currentRoom, 0);
+					session->next = openSessions;
+					if(openSessions != NULL)
+						openSessions->previous = session;
+					openSessions = session;
+
+					// Wait for write space first if the first prompt did not all go out
+					sendPrompt(world, session);
+					bool connected = flushSession(session);
+					event.events = session->outputLength > 0 ? EPOLLOUT : EPOLLIN;
+					event.data.ptr = session;
+					if(!connected || epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) < 0)
+						closeSession(epollFd, session);
+				}
+				continue;
+			}
+
+			// Handle input and send output until the socket is full or input runs out
+			bool connected;
+			do
+			{
+				connected = readSession(world, session);
+				if(connected && !session->dropped)
+					connected = flushSession(session);
+				while(connected && session->sendingPath && session->outputLength == 0)
+				{
+					queuePath(world, session);
+					connected = flushSession(session);
+				}
+			}
+			while(connected && session->inputBlocked && session->outputLength == 0);
+			if(!connected || session->dropped ||
+			   (session->closing && !session->sendingPath && session->outputLength == 0))
+			{
+				closeSession(epollFd, session);
+				continue;
+			}
+
+			// While output is backed up wait for write space only, the player's input
+			// stays in the socket until then
+			event.events = session->outputLength > 0 ? EPOLLOUT : EPOLLIN;
+			event.data.ptr = session;
+			epoll_ctl(epollFd, EPOLL_CTL_MOD, session->fd, &event);
+		}
+	}
+
+	// Players still connected at shutdown are hung up on
+	while(openSessions != NULL)
+		closeSession(epollFd, openSessions);
+	close(epollFd);
+	close(listenFd);
+	unlink(socketPath);
+	return true;
+}
+
+/***************************************************************************************
+* Formats time into timeService, caller holds my_mutex
+****************************************************************************************/
+void formatTime(time_t currentTime)
+{
+	// Looked here for info on using 
+	// https://www.tutorialspoint.com/c_standard_library/c_function_strftime.htm
+
+	struct tm info;
+	localtime_r(&currentTime, &info);
+	// Parses time info into desired format
+	strftime(timeService.timeString, 80, "%l:%M%P, %A, %B %e, %Y", &info);
+	timeService.formattedAt = currentTime;
+}
+
+/***************************************************************************************
+* Formats the first time and starts the time thread
+****************************************************************************************/
+bool startTimeService(bool writeFile)
+{
+	pthread_mutex_lock(&my_mutex);
+	formatTime(time(NULL));
+	timeService.writeFile = writeFile;
+	timeService.fileRequested = false;
+	timeService.running = true;
+	pthread_mutex_unlock(&my_mutex);
+
+	int result = pthread_create(&timeService.thread, NULL, writeTime, NULL);
+	if(result != 0)
+	{
+		fprintf(stderr, "pthread_create: %s\n", strerror(result));
+		timeService.running = false;
+		return false;
+	}
+	return true;
+}
+
+/***************************************************************************************
+* Tells the time thread to finish and waits for it
+****************************************************************************************/
+void stopTimeService()
+{
+	pthread_mutex_lock(&my_mutex);
+	timeService.running = false;
+	pthread_cond_signal(&timeService.wake);
+	pthread_mutex_unlock(&my_mutex);
+
+	pthread_join(timeService.thread, NULL);
+}
+
+/***************************************************************************************
+* Time thread. Reformats the time once per second and writes it to currentTime.txt
+* whenever the game asks for the file.
+****************************************************************************************/
+void* writeTime(void* arguments)
+{
+	char timeString[80];
+
+	pthread_mutex_lock(&my_mutex);
+	while(timeService.running)
+	{
+		time_t currentTime = time(NULL);
+		if(currentTime != timeService.formattedAt)
+			formatTime(currentTime);
+
+		if(timeService.fileRequested)
+		{
+			timeService.fileRequested = false;
+			strcpy(timeString, timeService.timeString);
+
+			// Write without the lock so the game never waits on the file
+			pthread_mutex_unlock(&my_mutex);
+			FILE *filePointer = fopen("currentTime.txt", "w");
+			if(filePointer != NULL)
+			{
+				// Prints time to file, overwriting anything that may already be there
+				fprintf(filePointer, "%s\n", timeString);
+				fclose(filePointer);
+			}
+			pthread_mutex_lock(&my_mutex);
+			continue;
+		}
+
+		// Sleep until the start of the next second or until woken
+		struct timespec wakeAt = { .tv_sec = currentTime + 1, .tv_nsec = 0 };
+		pthread_cond_timedwait(&timeService.wake, &my_mutex, &wakeAt);
+	}
+	pthread_mutex_unlock(&my_mutex);
+	return NULL;
+}
+
+
+/***************************************************************************************
+* Copies the time kept by the time thread into timeString, which holds 80 characters
+****************************************************************************************/
+void getTime(char *timeString)
+{
+	pthread_mutex_lock(&my_mutex);
+	strcpy(timeString, timeService.timeString);
+	// File is written in the background, game does not wait for it
+	if(timeService.writeFile)
+	{
+		timeService.fileRequested = true;
+		pthread_cond_signal(&timeService.wake);
+	}
+	pthread_mutex_unlock(&my_mutex);
+}
+
+/***************************************************************************************
+* Outputs the time kept by the time thread to user in console
+****************************************************************************************/
+void readTime()
+{
+	char timeString[80];
+	getTime(timeString);
+
+	// Same output as when the line was read back from currentTime.txt
+	printf("%s\n\n\n", timeString);
+}
+
+/***************************************************************************************
+* Opens fileName for the event log and starts the writer thread. Binary files start
+* with EVENT_FILE_MAGIC, the version and the size of a record.
+****************************************************************************************/
+bool startEventLog(const char *fileName, const char *format)
+{
+	eventLog.binary = strcmp(format, "binary") == 0;
+	eventLog.fd = open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(eventLog.fd < 0)
+	{
+		perror(fileName);
+		return false;
+	}
+	if(eventLog.binary)
+	{
+		char header[16];
+		uint32_t version = EVENT_FILE_VERSION, recordSize = sizeof(struct GameEvent);
+		memcpy(header, EVENT_FILE_MAGIC, 8);
+		memcpy(header + 8, &version, 4);
+		memcpy(header + 12, &recordSize, 4);
+		if(write(eventLog.fd, header, sizeof(header)) != sizeof(header))
+		{
+			perror(fileName);
+			close(eventLog.fd);
+			return false;
+		}
+	}
+
+	eventLog.running = true;
+	int result = pthread_create(&eventLog.thread, NULL, writeEvents, NULL);
+	if(result != 0)
+	{
+		fprintf(stderr, "pthread_create: %s\n", strerror(result));
+		close(eventLog.fd);
+		return false;
+	}
+	eventLog.enabled = true;
+	return true;
+}
+
+/***************************************************************************************
+* Waits for the writer to record every event logged so far, then closes the file.
+* Does nothing if the event log was never started.
+****************************************************************************************/
+void stopEventLog()
+{
+	if(!eventLog.enabled)
+		return;
+	eventLog.enabled = false;
+	__atomic_store_n(&eventLog.running, false, __ATOMIC_RELEASE);
+	pthread_join(eventLog.thread, NULL);
+	close(eventLog.fd);
+	if(eventLog.dropped > 0)
+		fprintf(stderr, "%" PRIu64 " events were dropped, the writer fell behind\n", eventLog.dropped);
+}
+
+/***************************************************************************************
+* Puts an event in the ring for the writer thread. Never waits: when the ring is full
+* the event is counted as dropped and the game goes on.
+****************************************************************************************/
+void logEvent(enum EventType type, uint32_t session, uint32_t room, uint32_t detail)
+{
+	if(!eventLog.enabled)
+		return;
+
+	// Only look at the writer's tail again when the ring seems full
+	uint64_t head = eventLog.head;
+	if(head - eventLog.tailSeen == EVENT_RING_SIZE)
+	{
+		eventLog.tailSeen = __atomic_load_n(&eventLog.tail, __ATOMIC_ACQUIRE);
+		if(head - eventLog.tailSeen == EVENT_RING_SIZE)
+		{
+			__atomic_store_n(&eventLog.dropped, eventLog.dropped + 1, __ATOMIC_RELAXED);
+			return;
+		}
+	}
+
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	struct GameEvent *event = &eventLog.events[head & (EVENT_RING_SIZE - 1)];
+	event->time = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+	event->session = session;
+	event->room = room;
+	event->detail = detail;
+	event->type = type;
+	// Event is filled in before the writer can see it
+	__atomic_store_n(&eventLog.head, head + 1, __ATOMIC_RELEASE);
+}
+
+/***************************************************************************************
+* Writes event as one JSON line into line, which holds EVENT_LINE_SIZE characters, and
+* returns its length
+****************************************************************************************/
+int formatEvent(const struct GameEvent *event, char *line)
+{
+	int length = snprintf(line, EVENT_LINE_SIZE, "{\"time_ns\":%" PRIu64 ",\"session\":%u,\"event\":\"%s\"",
+	                      event->time, event->session, eventNames[event->type]);
+	if(event->type != EVENT_DROPPED)
+		length += snprintf(line + length, EVENT_LINE_SIZE - length, ",\"room\":%u", event->room);
+	if(event->type == EVENT_MOVE)
+		length += snprintf(line + length, EVENT_LINE_SIZE - length, ",\"from\":%u", event->detail);
+	else if(event->type == EVENT_END || event->type == EVENT_QUIT)
+		length += snprintf(line + length, EVENT_LINE_SIZE - length, ",\"steps\":%u", event->detail);
+	else if(event->type == EVENT_DROPPED)
+		length += snprintf(line + length, EVENT_LINE_SIZE - length, ",\"count\":%u", event->detail);
+	length += snprintf(line + length, EVENT_LINE_SIZE - length, "}\n");
+	return length;
+}
+
+/***************************************************************************************
+* Event writer thread. Takes every event waiting in the ring, gathers their records
+* into one buffer and writes them together, then sleeps while the ring is empty. Each
+* time more events were dropped a dropped record says how many.
+****************************************************************************************/
+void* writeEvents(void* arguments)
+{
+	static char buffer[EVENT_BATCH_SIZE];
+	size_t used = 0;
+	bool stopping = false;
+
+	while(!stopping)
+	{
+		// Read before head, so every event logged before the stop is written
+		stopping = !__atomic_load_n(&eventLog.running, __ATOMIC_ACQUIRE);
+		uint64_t head = __atomic_load_n(&eventLog.head, __ATOMIC_ACQUIRE);
+		uint64_t tail = eventLog.tail;
+		bool idle = tail == head;
+
+		struct GameEvent dropped = { .type = EVENT_DROPPED };
+		uint64_t numDropped = __atomic_load_n(&eventLog.dropped, __ATOMIC_RELAXED);
+		if(numDropped != eventLog.droppedWritten)
+		{
+			struct timespec now;
+			clock_gettime(CLOCK_REALTIME, &now);
+			dropped.time = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+			dropped.detail = numDropped - eventLog.droppedWritten;
+			eventLog.droppedWritten = numDropped;
+		}
+
+		while(tail != head || dropped.detail > 0)
+		{
+			const struct GameEvent *event = tail != head ? &eventLog.events[tail & (EVENT_RING_SIZE - 1)] : &dropped;
+			if(eventLog.binary)
+			{
+				memcpy(buffer + used, event, sizeof(struct GameEvent));
+				used += sizeof(struct GameEvent);
+			}
+			else
+				used += formatEvent(event, buffer + used);
+			if(event == &dropped)
+				dropped.detail = 0;
+			else
+				tail++;
+
+			if(used + EVENT_LINE_SIZE > EVENT_BATCH_SIZE || (tail == head && dropped.detail == 0))
+			{
+				// Slots are handed back before the write, the records are in buffer
+				__atomic_store_n(&eventLog.tail, tail, __ATOMIC_RELEASE);
+				size_t written = 0;
+				while(!eventLog.failed && written < used)
+				{
+					ssize_t result = write(eventLog.fd, buffer + written, used - written);
+					if(result < 0 && errno == EINTR)
+						continue;
+					if(result <= 0)
+					{
+						perror("Writing events");
+						eventLog.failed = true;
+					}
+					else
+						written += result;
+				}
+				used = 0;
+			}
+		}
+
+		if(idle && !stopping)
+		{
+			struct timespec pause = { .tv_sec = 0, .tv_nsec = EVENT_IDLE_NS };
+			nanosleep(&pause, NULL);
+		}
+	}
+	return NULL;
 }
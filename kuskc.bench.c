@@ -0,0 +1,121 @@
+/********************************************************************************
+  Benchmark helper for kuskc.bench.sh. Writes random walks through a world as
+  adventure batch input, and times move lookups on the world directly so the
+  cost of one worldMoveTarget can be told apart from batch input and output.
+
+  Build: gcc -O2 -o kuskc.bench kuskc.bench.c kuskc.world.c kuskc.stats.c -lpthread
+*********************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "kuskc.world.h"
+#include "kuskc.stats.h"
+
+// Function Declarations
+uint32_t nextRandom(uint64_t*);
+bool writeWalks(const struct World*, uint64_t, int, uint32_t, const char*);
+double timeLookups(const struct World*, uint64_t, uint32_t);
+
+/***************************************************************************************
+* Main Function
+****************************************************************************************/
+int main(int argc, char *argv[])
+{
+	if(argc != 6)
+	{
+		fprintf(stderr, "Usage: %s WORLD_FILE SEED WALKS STEPS MOVES_FILE\n", argv[0]);
+		fprintf(stderr, "  Writes WALKS random walks of STEPS moves to MOVES_FILE, then prints\n");
+		fprintf(stderr, "  nanoseconds per worldMoveTarget over the same number of moves\n");
+		return 1;
+	}
+	uint64_t seed = strtoull(argv[2], NULL, 0);
+	int numWalks = atoi(argv[3]);
+	uint32_t numSteps = strtoul(argv[4], NULL, 0);
+
+	struct World world;
+	if(!worldOpen(&world, argv[1]))
+		return 1;
+	bool written = writeWalks(&world, seed, numWalks, numSteps, argv[5]);
+	if(written)
+		printf("%.2f\n", timeLookups(&world, seed, (uint32_t)numWalks * numSteps));
+	worldClose(&world);
+	return written ? 0 : 1;
+}
+
+/***************************************************************************************
+* Returns next 32 random bits, xorshift64* like buildrooms
+****************************************************************************************/
+uint32_t nextRandom(uint64_t *state)
+{
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return (*state * 0x2545F4914F6CDD1Dull) >> 32;
+}
+
+/***************************************************************************************
+* Writes numWalks lines of numSteps room names, each walk starting in the START room
+* and taking a random connection every step. END is never entered, adventure would
+* ignore every move after it.
+****************************************************************************************/
+bool writeWalks(const struct World *world, uint64_t seed, int numWalks, uint32_t numSteps, const char *fileName)
+{
+	FILE *movesFile = fopen(fileName, "w");
+	if(movesFile == NULL)
+	{
+		perror(fileName);
+		return false;
+	}
+
+	uint64_t state = seed | 1;
+	int walk;
+	uint32_t step;
+	for(walk = 0; walk < numWalks; walk++)
+	{
+		uint32_t room = world->header->startRoom;
+		for(step = 0; step < numSteps; step++)
+		{
+			uint32_t nextRoom;
+			do
+				nextRoom = worldConnection(world, room, nextRandom(&state) % worldNumConnections(world, room));
+			while(nextRoom == world->header->endRoom);
+			room = nextRoom;
+			fprintf(movesFile, step ? " %s" : "%s", worldRoomName(world, room));
+		}
+		fputc('\n', movesFile);
+	}
+
+	if(fclose(movesFile) != 0)
+	{
+		perror(fileName);
+		return false;
+	}
+	return true;
+}
+
+/***************************************************************************************
+* Returns average nanoseconds of one worldMoveTarget along a random walk of numMoves
+****************************************************************************************/
+double timeLookups(const struct World *world, uint64_t seed, uint32_t numMoves)
+{
+	uint64_t state = seed | 1;
+	uint32_t room = world->header->startRoom;
+	uint32_t move;
+
+	uint64_t start = statsNow();
+	for(move = 0; move < numMoves; move++)
+	{
+		// Look up the name of a random connection, as a player typing it would
+		const char *name = worldRoomName(world, worldConnection(world, room,
+		                   nextRandom(&state) % worldNumConnections(world, room)));
+		room = worldMoveTarget(world, room, name);
+	}
+	uint64_t elapsed = statsNow() - start;
+
+	// Room is printed nowhere, but reading it keeps the loop from being optimized away
+	if(room == WORLD_NO_ROOM)
+		fprintf(stderr, "Walk left the world\n");
+	return numMoves ? (double)elapsed / numMoves : 0.0;
+}
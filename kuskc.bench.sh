@@ -0,0 +1,162 @@
+#!/bin/sh
+################################################################################
+#  Benchmarks buildrooms and adventure at several world sizes and writes the
+#  median of every measurement to a tab separated file, one line per size and
+#  metric, so results of two commits can be compared with diff.
+#
+#  Usage: sh kuskc.bench.sh BIN_DIR [RESULTS_FILE]
+#  BIN_DIR holds kuskc.buildrooms, kuskc.adventure and kuskc.bench built with
+#  -DKUSKC_STATS, make bench does this. Settings come from the environment:
+#    SIZES        room counts (default "7 100 10000 1000000")
+#    SEED         master seed of every world (default 1)
+#    WARMUP       runs thrown away before measuring (default 1)
+#    RUNS         measured runs, the median is kept (default 5)
+#    TEXT_ROOMS   largest size that also gets text room files (default 100000)
+#    LEGACY_ROOMS largest size timed with buildrooms --legacy (default 10000)
+#    MOVES        moves replayed in batch mode per run (default 1000000)
+################################################################################
+
+BIN_DIR=${1:?usage: $0 BIN_DIR [RESULTS_FILE]}
+RESULTS=${2:-$BIN_DIR/results.tsv}
+SIZES=${SIZES:-"7 100 10000 1000000"}
+SEED=${SEED:-1}
+WARMUP=${WARMUP:-1}
+RUNS=${RUNS:-5}
+TEXT_ROOMS=${TEXT_ROOMS:-100000}
+LEGACY_ROOMS=${LEGACY_ROOMS:-10000}
+MOVES=${MOVES:-1000000}
+
+# Runs happen in a scratch directory, so both paths are made absolute first
+BIN_DIR=$(cd "$BIN_DIR" && pwd) || exit 1
+RESULTS=$(cd "$(dirname "$RESULTS")" && pwd)/$(basename "$RESULTS") || exit 1
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/kuskc.bench.XXXXXX") || exit 1
+trap 'rm -rf "$WORK"' EXIT
+trap 'exit 1' INT TERM
+SAMPLES=$WORK/samples
+: > "$SAMPLES"
+
+# Prints total_ns of a timer that ran, or the value of a counter, from a stats report
+statValue()
+{
+	sed -n "s/^  \"$2\": {\"count\": [1-9][0-9]*, \"total_ns\": \([0-9]*\)}.*/\1/p; s/^  \"$2\": \([0-9]*\),\{0,1\}}\{0,1\}$/\1/p" "$1"
+}
+
+# Appends one sample: size, metric, value, unit
+sample()
+{
+	if [ -n "$3" ]; then
+		printf '%s\t%s\t%s\t%s\n' "$1" "$2" "$3" "$4" >> "$SAMPLES"
+	fi
+}
+
+# Runs a command WARMUP times, then RUNS times calling record after each run
+repeat()
+{
+	run=1
+	while [ $run -le $((WARMUP + RUNS)) ]; do
+		"$@" || { echo "$0: $* failed" >&2; exit 1; }
+		[ $run -gt "$WARMUP" ] && record
+		run=$((run + 1))
+	done
+}
+
+for size in $SIZES; do
+	echo "$size rooms" >&2
+	rm -rf "$WORK/world" && mkdir "$WORK/world" && cd "$WORK/world" || exit 1
+	format=binary
+	[ "$size" -le "$TEXT_ROOMS" ] && format=both
+
+	# Generation, every run builds the same world into a fresh directory
+	build()
+	{
+		rm -rf kuskc.rooms.* kuskc.latest kuskc.latest.lock
+		"$BIN_DIR/kuskc.buildrooms" -s "$SEED" -n "$size" -f $format -j 1 -S "$WORK/stats" > /dev/null
+	}
+	record()
+	{
+		for timer in connect_rooms room_files world_file distances diameter; do
+			sample "$size" "$timer" "$(statValue "$WORK/stats" $timer)" ns
+		done
+		sample "$size" pick_retries "$(statValue "$WORK/stats" pick_retries)" count
+	}
+	repeat build
+
+	if [ "$size" -le "$LEGACY_ROOMS" ]; then
+		legacy()
+		{
+			"$BIN_DIR/kuskc.buildrooms" -l -s "$SEED" -n "$size" -f binary -j 1 -S "$WORK/stats" > /dev/null
+		}
+		record()
+		{
+			sample "$size" legacy_connect_rooms "$(statValue "$WORK/stats" connect_rooms)" ns
+		}
+		repeat legacy
+		# Leave the world the other runs measured as the newest
+		build || exit 1
+	fi
+
+	# Move lookup on its own, and moves replayed through batch mode
+	walks=$(( (MOVES + 999) / 1000 ))
+	lookup()
+	{
+		"$BIN_DIR/kuskc.bench" kuskc.rooms.*/world.bin "$SEED" $walks 1000 "$WORK/moves" > "$WORK/lookup"
+	}
+	record()
+	{
+		sample "$size" lookup "$(cat "$WORK/lookup")" ns/move
+	}
+	repeat lookup
+
+	batch()
+	{
+		"$BIN_DIR/kuskc.adventure" -b "$WORK/moves" -S "$WORK/stats" > /dev/null 2> "$WORK/batch"
+	}
+	record()
+	{
+		sample "$size" find_directory "$(statValue "$WORK/stats" find_directory)" ns
+		sample "$size" open_world "$(statValue "$WORK/stats" open_world)" ns
+		sample "$size" batch_moves "$(sed -n 's/.*, \([0-9]*\) moves per second$/\1/p' "$WORK/batch")" moves/s
+	}
+	repeat batch
+
+	# Discovery and parsing of text room files, world.bin is hidden so they are read
+	if [ $format = both ]; then
+		mv kuskc.rooms.*/world.bin "$WORK/world.bin" || exit 1
+		parse()
+		{
+			"$BIN_DIR/kuskc.adventure" -b /dev/null -S "$WORK/stats" > /dev/null 2>&1
+		}
+		record()
+		{
+			sample "$size" read_rooms "$(statValue "$WORK/stats" read_rooms)" ns
+			sample "$size" set_connections "$(statValue "$WORK/stats" set_connections)" ns
+		}
+		repeat parse
+	fi
+done
+
+# Median of every size and metric, in the order they were first measured
+awk -F '\t' '
+	{
+		key = $1 "\t" $2
+		if(!(key in count)) { order[++keys] = key; unit[key] = $4 }
+		values[key, ++count[key]] = $3
+	}
+	END {
+		printf "# rooms\tmetric\tmedian\tunit\n"
+		for(k = 1; k <= keys; k++)
+		{
+			key = order[k]; n = count[key]
+			# Insertion sort, there are only RUNS values
+			for(i = 2; i <= n; i++)
+			{
+				v = values[key, i]
+				for(j = i - 1; j >= 1 && values[key, j] + 0 > v + 0; j--)
+					values[key, j + 1] = values[key, j]
+				values[key, j + 1] = v
+			}
+			median = n % 2 ? values[key, (n + 1) / 2] : (values[key, n / 2] + values[key, n / 2 + 1]) / 2
+			printf "%s\t%s\t%s\n", key, median, unit[key]
+		}
+	}' "$SAMPLES" > "$RESULTS" || exit 1
+echo "Results written to $RESULTS" >&2
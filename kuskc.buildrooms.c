@@ -1,6 +1,9 @@
 /********************************************************************************
   Creates a series of files that hold descriptions of the in-game rooms and how
   rooms are connected
+
+  Build: gcc -o kuskc.buildrooms kuskc.buildrooms.c kuskc.world.c kuskc.stats.c -lpthread
+  Add -DKUSKC_STATS to turn on --stats, see kuskc.stats.h
 *********************************************************************************/
 
 #include <stdio.h>
@@ -9,129 +12,479 @@
 #include <unistd.h>	// Needed for Process ID
 #include <stdbool.h>
 #include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <getopt.h>	// Needed for command line options
+#include <dirent.h>	// Needed to prune old directories
+#include <pthread.h>	// Needed for bulk generation
+#include <inttypes.h>
+#include <fcntl.h>
+#include <errno.h>
+#include "kuskc.world.h"
+#include "kuskc.stats.h"
+
+// Which files createDirectoryAndFiles writes
+#define FORMAT_TEXT   1	// One text file per room
+#define FORMAT_BINARY 2	// Single world.bin file
+#define FORMAT_SOURCE 4	// world.h to compile into adventure, see worldSaveSource
+#define FORMAT_ARCHIVE 8	// Appended to WORLD_ARCHIVE_NAME, no directory is made
+
+#define ROOM_FILE_SIZE 256	// Longest room file is under 160 bytes
+
+// How far createDirectoryAndFiles pushes a world to disk before renaming it into place
+#define SYNC_NONE  0	// Leave it to the kernel
+#define SYNC_FILES 1	// fsync every file
+#define SYNC_ALL   2	// Also fsync the directory before and its parent after the rename
 
 // Global Variables
 int NUM_ROOMS = 7;
+int MIN_ROOMS = 7;          // Classic game size, also smallest graph we build
+int MAX_ROOMS = 10000000;   // Generated names are R0 through R9999999
+int DISTANCE_THREADS = 1;   // Threads used to find distances to END in each world
+int BITSET_ROOMS = 4096;    // Largest world given an adjacency bit matrix, 2MB at this size
+int SYNC_POLICY = SYNC_NONE;
+uint64_t MASTER_SEED = 0;   // Recorded with every archived world
+
+// Hard coded string array of room names, each world shuffles its own order
+const char *roomNameList[10] = {"Lion", "Wolf", "Kraken", "Dragon", "Stag", "Hawk", "Dog", "Bear", "Crow", "Trout"};
+
+// Random number stream, one per world so worlds can be built on any thread
+struct Random
+{
+	uint64_t state;
+};
 
 // Definition for Room struct
 struct Room
 {
-	char name[9];                        // Max of 8 characters + null terminator
-	char type[12]; 	                     // START_ROOM, END_ROOM, MID_ROOM
-	int numConnections;                  // Must be between 3 and 6
-	struct Room* outboundConnections[6]; // Declare max for struct size
+	uint32_t id;                         // Index in roomArray and room number in world file
+	uint8_t type;                        // START_ROOM, END_ROOM, MID_ROOM
+	uint8_t numConnections;              // Must be between 3 and 6
+	uint8_t nameIndex;                   // Index into roomNameList for classic sized worlds
+	uint32_t outboundConnections[6];     // Room numbers of connected rooms
+};
+
+// Rooms being connected, plus what keeps the connection checks O(1)
+struct RoomGraph
+{
+	struct Room *rooms;
+	int numUnderFilled;          // Rooms with fewer than 3 connections, graph is full at 0
+	uint64_t *adjacency;         // NUM_ROOMS x NUM_ROOMS bit matrix, NULL for larger worlds
+};
+
+// Pool of room indices that supports O(1) random pick and removal
+struct RoomPool
+{
+	int *rooms;     // Room indices currently in the pool
+	int *position;  // position[room] is index into rooms, -1 if not in pool
+	int count;      // Number of rooms currently in pool
+};
+
+// Rooms directory found while pruning
+struct WorldDirectory
+{
+	char name[256];
+	struct timespec modified;
+};
+
+// World built by a bulk thread and held in memory until the writer saves it
+struct BulkWorld
+{
+	int worldNumber;
+	struct Room *rooms;          // Still needed for room file names
+	char *roomFiles;             // Text room files one after another, NULL if none
+	size_t *roomFileEnds;        // roomFileEnds[x] is where room x's file ends
+	struct World world;          // Packed world, base is NULL if none
+	struct BulkWorld *next;
+};
+
+// Work shared by bulk generation threads
+struct BulkJob
+{
+	uint64_t seed;          // Master seed, world k uses stream k
+	int numWorlds;
+	bool useLegacy;
+	int format;
+	bool writeInline;       // No thread started, the caller builds and writes each world
+	pthread_mutex_t lock;   // Guards everything below
+	pthread_cond_t ready;   // Signalled when a world is buffered or a builder is done
+	pthread_cond_t space;   // Signalled when the writer frees a buffered world
+	int nextWorld;          // Next world number to hand out
+	int failures;
+	int numBuilders;        // Builder threads still running
+	int numBuffered;        // Worlds built but not yet written
+	int maxBuffered;        // Builders wait once this many worlds are held
+	struct BulkWorld *first, *last;  // Built worlds waiting for the writer
 };
 
 // Function Declarations
-void initializeRooms(struct Room*);
-bool IsGraphFull(struct Room*);
-struct Room *GetRandomRoom(struct Room*);
-bool ConnectionAlreadyExists(struct Room*, struct Room*);
+void usage(const char*);
+void seedRandom(struct Random*, uint64_t, uint64_t);
+uint32_t nextRandom(struct Random*);
+uint32_t randomBelow(struct Random*, uint32_t);
+void initializeRooms(struct Room*, struct Random*);
+const char *getRoomName(const struct Room*, char*);
+bool initializeGraph(struct RoomGraph*, struct Room*);
+void destroyGraph(struct RoomGraph*);
+bool IsGraphFull(struct RoomGraph*);
+struct Room *GetRandomRoom(struct Room*, struct Random*);
+bool ConnectionAlreadyExists(struct RoomGraph*, struct Room*, struct Room*);
 bool CanAddConnectionFrom(struct Room*);
 bool IsSameRoom(struct Room*, struct Room*);
-void ConnectRoom(struct Room*, struct Room*);
-void AddRandomConnection(struct Room*);
+void ConnectRoom(struct RoomGraph*, struct Room*, struct Room*);
+void AddRandomConnection(struct RoomGraph*, struct Random*);
+void DisconnectRoom(struct RoomGraph*, struct Room*, struct Room*);
+void initializePool(struct RoomPool*);
+void removeFromPool(struct RoomPool*, int);
+void destroyPool(struct RoomPool*);
+void updatePools(struct Room*, struct RoomPool*, struct RoomPool*);
+void SwapInConnections(struct RoomGraph*, struct Room*, struct RoomPool*, struct RoomPool*);
+void BuildRandomGraph(struct RoomGraph*, struct Random*);
 void displayRooms(struct Room*);
-void createRoomFiles(struct Room*);
-void createDirectoryAndFiles(struct Room*);
+bool writeFile(int, const char*, const char*, const char*, size_t);
+bool syncDirectory(const char*);
+int formatRoomFile(const struct Room*, int, char*);
+bool createRoomFiles(struct Room*, const char*);
+bool formatRoomFiles(struct BulkWorld*);
+bool writeRoomFiles(const struct BulkWorld*, const char*);
+bool packWorld(struct Room*, struct World*, const char*);
+bool saveWorld(const struct World*, const char*, int, int);
+bool createWorldFile(struct Room*, const char*, int, int);
+bool makeTempDirectory(int, char*, char*);
+bool placeDirectory(const char*, const char*, bool);
+bool createDirectoryAndFiles(struct Room*, int, int, char*);
+struct Room *connectRooms(struct Random*, bool);
+bool generateWorld(struct Random*, bool, int, int, char*);
+bool buildBulkWorld(struct BulkJob*, int, struct BulkWorld*);
+bool writeBulkWorld(struct BulkJob*, struct BulkWorld*);
+void freeBulkWorld(struct BulkWorld*);
+void *bulkWorker(void*);
+void writeBulk(struct BulkJob*);
+bool generateBulk(uint64_t, int, int, bool, int);
+int compareNewestFirst(const void*, const void*);
+bool removeDirectory(const char*);
+int pruneWorlds(int);
 
 /***************************************************************************************
 * Main Function
 ****************************************************************************************/
-int main(void)
+int main(int argc, char *argv[])
 {
-	// Seed random
-	srand(time(NULL));
+	bool useLegacy = false;	// Use the original rejection sampling loop
+	int keepWorlds = -1;	// Worlds left after pruning, -1 keeps everything
+	bool pruneOnly = false;	// Prune without building a world
+	int format = FORMAT_BINARY;	// Files written to rooms directory
+	uint64_t seed = (uint64_t)time(NULL) << 32 ^ getpid();	// Runs in the same second still differ
+	int numWorlds = 0;	// Worlds to build in bulk, 0 builds one the classic way
+	int numThreads = sysconf(_SC_NPROCESSORS_ONLN);	// Threads used for bulk builds
+	const char *statsFile = NULL;	// Write timings and counters here, - for stderr
 
+	static struct option longOptions[] =
+	{
+		{"rooms",  required_argument, NULL, 'n'},
+		{"legacy", no_argument,       NULL, 'l'},
+		{"format", required_argument, NULL, 'f'},
+		{"keep",   required_argument, NULL, 'k'},
+		{"prune",  required_argument, NULL, 'p'},
+		{"seed",   required_argument, NULL, 's'},
+		{"worlds", required_argument, NULL, 'w'},
+		{"threads", required_argument, NULL, 'j'},
+		{"sync",   required_argument, NULL, 'y'},
+		{"stats",  required_argument, NULL, 'S'},
+		{"help",   no_argument,       NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
 
-	// roomArray will have 7 elements
-	struct Room roomArray[NUM_ROOMS];
+	int option;
+	while ((option = getopt_long(argc, argv, "n:lf:k:p:s:w:j:y:S:h", longOptions, NULL)) != -1)
+	{
+		switch (option)
+		{
+			case 'n':
+				NUM_ROOMS = atoi(optarg);
+				break;
+			case 'l':
+				useLegacy = true;
+				break;
+			case 's':
+				seed = strtoull(optarg, NULL, 0);
+				break;
+			case 'w':
+				numWorlds = atoi(optarg);
+				if(numWorlds < 1)
+				{
+					fprintf(stderr, "Number of worlds must be at least 1\n");
+					return 1;
+				}
+				break;
+			case 'j':
+				numThreads = atoi(optarg);
+				break;
+			case 'k':
+			case 'p':
+				keepWorlds = atoi(optarg);
+				pruneOnly = option == 'p';
+				if(keepWorlds < 1)
+				{
+					fprintf(stderr, "Number of worlds to keep must be at least 1\n");
+					return 1;
+				}
+				break;
+			case 'S':
+				statsFile = optarg;
+				break;
+			case 'y':
+				if(strcmp(optarg, "none") == 0)
+					SYNC_POLICY = SYNC_NONE;
+				else if(strcmp(optarg, "files") == 0)
+					SYNC_POLICY = SYNC_FILES;
+				else if(strcmp(optarg, "all") == 0)
+					SYNC_POLICY = SYNC_ALL;
+				else
+				{
+					usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 'f':
+				if(strcmp(optarg, "text") == 0)
+					format = FORMAT_TEXT;
+				else if(strcmp(optarg, "binary") == 0)
+					format = FORMAT_BINARY;
+				else if(strcmp(optarg, "both") == 0)
+					format = FORMAT_TEXT | FORMAT_BINARY;
+				else if(strcmp(optarg, "source") == 0)
+					format = FORMAT_SOURCE;
+				else if(strcmp(optarg, "archive") == 0)
+					format = FORMAT_ARCHIVE;
+				else
+				{
+					usage(argv[0]);
+					return 1;
+				}
+				break;
+			default:
+				usage(argv[0]);
+				return option == 'h' ? 0 : 1;
+		}
+	}
 
-	// Initializes the room structs
-	initializeRooms(roomArray);
+	if (pruneOnly)
+		return pruneWorlds(keepWorlds) < 0 ? 1 : 0;
 
-	// Create all connections in graph
-	while (IsGraphFull(roomArray) == false)
+	if (NUM_ROOMS < MIN_ROOMS || NUM_ROOMS > MAX_ROOMS)
+	{
+		fprintf(stderr, "Number of rooms must be between %d and %d\n", MIN_ROOMS, MAX_ROOMS);
+		return 1;
+	}
+
+	if (numThreads < 1)
+		numThreads = 1;
+	MASTER_SEED = seed;
+
+	// Bulk builds already keep every core busy with whole worlds
+	DISTANCE_THREADS = numWorlds > 0 ? 1 : numThreads;
+
+	// Before any thread starts, see statsStart
+	if (statsFile != NULL && !statsStart("buildrooms", statsFile))
+		return 1;
+
+	if (numWorlds > 0)
 	{
-                AddRandomConnection(roomArray);
+		if (!generateBulk(seed, numWorlds, numThreads, useLegacy, format))
+			return 1;
 	}
+	else
+	{
+		// Single world uses stream 0, same as the first bulk world
+		struct Random random;
+		seedRandom(&random, seed, 0);
 
-	// Creates directory and room files
-	createDirectoryAndFiles(roomArray);
+		char directoryName[64];
+		uint64_t sequence;
+		// Archived worlds are found through the archive, not the manifest
+		if (!generateWorld(&random, useLegacy, format, -1, directoryName) ||
+		    (format != FORMAT_ARCHIVE && !worldPublish(directoryName, &sequence)))
+			return 1;
+	}
 
+	// Keep the number of old worlds bounded
+	if (keepWorlds > 0 && pruneWorlds(keepWorlds) < 0)
+		return 1;
 	return 0;
 }
 
+/***************************************************************************************
+* Prints command line options
+****************************************************************************************/
+void usage(const char *programName)
+{
+	fprintf(stderr, "Usage: %s [options]\n", programName);
+	fprintf(stderr, "  -n, --rooms N   number of rooms to generate (default 7)\n");
+	fprintf(stderr, "  -l, --legacy    connect rooms with the original rejection sampling loop\n");
+	fprintf(stderr, "  -f, --format F  text, binary, both, source or archive (default binary),\n");
+	fprintf(stderr, "                  source writes world.h for make embedded, archive appends\n");
+	fprintf(stderr, "                  to %s instead of making a rooms directory\n", WORLD_ARCHIVE_NAME);
+	fprintf(stderr, "  -k, --keep N    after building, delete all but the N newest worlds\n");
+	fprintf(stderr, "  -p, --prune N   delete all but the N newest worlds without building\n");
+	fprintf(stderr, "  -s, --seed S    master seed, the same seed builds the same worlds\n");
+	fprintf(stderr, "  -w, --worlds K  build K worlds in parallel\n");
+	fprintf(stderr, "  -j, --threads T threads used (default all cores)\n");
+	fprintf(stderr, "  -y, --sync M    fsync none, files or all before a world appears (default none)\n");
+	fprintf(stderr, "  -S, --stats F   write timings and counters as JSON to F (- for stderr) at exit\n");
+	fprintf(stderr, "                  and on SIGUSR1, needs a -DKUSKC_STATS build\n");
+	fprintf(stderr, "  -h, --help      show this message\n");
+}
+
+
+/***************************************************************************************
+* Starts stream number stream of the master seed. Seeds go through splitmix64 so
+* nearby seeds and streams give unrelated sequences.
+****************************************************************************************/
+void seedRandom(struct Random *random, uint64_t seed, uint64_t stream)
+{
+	uint64_t z = seed + (stream + 1) * 0x9E3779B97F4A7C15ull;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	z = z ^ (z >> 31);
+
+	// xorshift never leaves an all zero state
+	random->state = z != 0 ? z : 0x9E3779B97F4A7C15ull;
+}
 
 /***************************************************************************************
-* Creates 7 room structs with random order and room types
+* Returns next 32 random bits, xorshift64*
 ****************************************************************************************/
-void initializeRooms(struct Room *roomArray)
+uint32_t nextRandom(struct Random *random)
 {
-	// Hard coded string array of room names
-	char *roomNameList[10] = {"Lion", "Wolf", "Kraken", "Dragon", "Stag", "Hawk", "Dog", "Bear", "Crow", "Trout"};
+	random->state ^= random->state >> 12;
+	random->state ^= random->state << 25;
+	random->state ^= random->state >> 27;
+	return (random->state * 0x2545F4914F6CDD1Dull) >> 32;
+}
+
+/***************************************************************************************
+* Returns random integer between 0 and n - 1
+****************************************************************************************/
+uint32_t randomBelow(struct Random *random, uint32_t n)
+{
+	// Multiply and shift is faster than % and just as even for n this small
+	return ((uint64_t)nextRandom(random) * n) >> 32;
+}
 
-	// Shuffling pointers more efficient than using strcpy
+/***************************************************************************************
+* Creates NUM_ROOMS room structs with random order and room types
+* Classic sized worlds pick from the hard coded names, larger ones are named R0, R1, ...
+****************************************************************************************/
+void initializeRooms(struct Room *roomArray, struct Random *random)
+{
+	// Shuffling indices, the name list itself is shared by every world
+	uint8_t nameOrder[10] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
 	int x;
-	char *temp;	// Used to swap elements
+	uint8_t temp;	// Used to swap elements
 	int randIndex, randIndex2; // Both randomnly set to shuffle array
 
 	// Does 50 random shuffles, appears to work well at randomizing order
 	for(x = 0; x < 50; x++)
 	{
 		// Generates random integer between 0 and 9
-		randIndex  = rand() % 10;	
-		randIndex2 = rand() % 10;
-		// Swaps char array pointers
-		temp = roomNameList[randIndex];
-		roomNameList[randIndex] = roomNameList[randIndex2];
-		roomNameList[randIndex2] = temp;
-	}
-
-	// After shuffling take first 7 as rooms to be used
-	
-	// Initialize first room as START
-	strcpy(roomArray[0].name, roomNameList[0]);
-	strcpy(roomArray[0].type, "START_ROOM");
-	roomArray[0].numConnections = 0;
-
-	// Initialize second room as END
-	strcpy(roomArray[1].name, roomNameList[1]);
-	strcpy(roomArray[1].type, "END_ROOM");
-	roomArray[1].numConnections = 0;
-
-	// Initialize the rest as MID
-	for(x = 2; x < NUM_ROOMS; x++)
-	{
-		strcpy(roomArray[x].name, roomNameList[x]);
-		strcpy(roomArray[x].type, "MID_ROOM");
+		randIndex  = randomBelow(random, 10);
+		randIndex2 = randomBelow(random, 10);
+		// Swaps name indices
+		temp = nameOrder[randIndex];
+		nameOrder[randIndex] = nameOrder[randIndex2];
+		nameOrder[randIndex2] = temp;
+	}
+
+	// After shuffling take first NUM_ROOMS as rooms to be used
+	for(x = 0; x < NUM_ROOMS; x++)
+	{
+		roomArray[x].id = x;
+		roomArray[x].nameIndex = NUM_ROOMS <= 10 ? nameOrder[x] : 0;
+		roomArray[x].type = MID_ROOM;
 		roomArray[x].numConnections = 0;
 	}
+
+	// START and END are two different random rooms
+	int startRoom = randomBelow(random, NUM_ROOMS);
+	int endRoom = randomBelow(random, NUM_ROOMS - 1);
+	if(endRoom >= startRoom)
+		endRoom++;
+	roomArray[startRoom].type = START_ROOM;
+	roomArray[endRoom].type = END_ROOM;
 }
 
 /***************************************************************************************
-* Boolean to determine if graph is full, returns true if it is full
+* Returns name of room. Classic sized worlds use the shuffled hard coded names, larger
+* ones format R<id> into buffer, which must hold 9 characters.
+****************************************************************************************/
+const char *getRoomName(const struct Room *x, char *buffer)
+{
+	if(NUM_ROOMS <= 10)
+		return roomNameList[x->nameIndex];
+	sprintf(buffer, "R%u", x->id);
+	return buffer;
+}
+
+/***************************************************************************************
+* Sets up graph over rooms made by initializeRooms, which have no connections yet.
+* Small worlds get an adjacency bit matrix, larger ones check the 6 connections.
 ****************************************************************************************/
-bool IsGraphFull(struct Room *roomArray)  
+bool initializeGraph(struct RoomGraph *graph, struct Room *roomArray)
 {
- 	int x;
-	// Loop through every element of array, return false if any have incorrect number
-	for(x = 0; x < NUM_ROOMS; x++) 
+	graph->rooms = roomArray;
+	graph->numUnderFilled = NUM_ROOMS;
+	graph->adjacency = NULL;
+	if(NUM_ROOMS <= BITSET_ROOMS)
 	{
-		if(roomArray[x].numConnections < 3 || roomArray[x].numConnections > 6)
+		graph->adjacency = calloc(((uint64_t)NUM_ROOMS * NUM_ROOMS + 63) / 64, sizeof(uint64_t));
+		if(graph->adjacency == NULL)
+		{
+			perror("calloc");
 			return false;
+		}
 	}
-	// Return true if all rooms have appropriate number of connections
 	return true;
 }
 
+/***************************************************************************************
+* Frees memory held by graph, the rooms belong to the caller
+****************************************************************************************/
+void destroyGraph(struct RoomGraph *graph)
+{
+	free(graph->adjacency);
+	graph->adjacency = NULL;
+}
+
+/***************************************************************************************
+* Flips the bits for x-y and y-x in the adjacency matrix, if there is one
+****************************************************************************************/
+static void flipAdjacency(struct RoomGraph *graph, struct Room *x, struct Room *y)
+{
+	if(graph->adjacency == NULL)
+		return;
+	uint64_t bit = (uint64_t)x->id * NUM_ROOMS + y->id;
+	graph->adjacency[bit / 64] ^= 1ull << (bit % 64);
+	bit = (uint64_t)y->id * NUM_ROOMS + x->id;
+	graph->adjacency[bit / 64] ^= 1ull << (bit % 64);
+}
+
+/***************************************************************************************
+* Boolean to determine if graph is full, returns true if it is full
+****************************************************************************************/
+bool IsGraphFull(struct RoomGraph *graph)  
+{
+	// ConnectRoom and DisconnectRoom keep count, no room ever goes over 6
+	return graph->numUnderFilled == 0;
+}
+
 /***************************************************************************************
 * Returns random room from roomArray, does not validate 
 ****************************************************************************************/
-struct Room *GetRandomRoom(struct Room *roomArray)
+struct Room *GetRandomRoom(struct Room *roomArray, struct Random *random)
 {
-	// Generates random integer between 0 and 6
-	int randIndex  = rand() % NUM_ROOMS;	
+	// Generates random integer between 0 and NUM_ROOMS - 1
+	int randIndex  = randomBelow(random, NUM_ROOMS);
 	return &roomArray[randIndex];	
 }
 
@@ -139,14 +492,20 @@ struct Room *GetRandomRoom(struct Room *roomArray)
 * Returnes true if connection already exists between two rooms
 ****************************************************************************************/
 // Returns true if a connection from Room x to Room y already exists, false otherwise
-bool ConnectionAlreadyExists(struct Room *x, struct Room *y)
+bool ConnectionAlreadyExists(struct RoomGraph *graph, struct Room *x, struct Room *y)
 {
+	if(graph->adjacency != NULL)
+	{
+		uint64_t bit = (uint64_t)x->id * NUM_ROOMS + y->id;
+		return (graph->adjacency[bit / 64] >> (bit % 64)) & 1;
+	}
+
 	int i;
 	// 6 Elements in outboundConnections array
 	for(i = 0; i < x->numConnections; i++)
 	{
-		// If any of outbound connections shares name with other passed in Room
-		if(strcmp(x->outboundConnections[i]->name, y->name) == 0)
+		// If any of outbound connections is the other passed in Room
+		if(x->outboundConnections[i] == y->id)
 		{
 			return true;
 		}
@@ -168,13 +527,12 @@ bool CanAddConnectionFrom(struct Room *x)
 }
 
 /***************************************************************************************
-* Returns true if two rooms have the same name (are same room)
+* Returns true if two rooms have the same id (are same room)
 ****************************************************************************************/
 bool IsSameRoom(struct Room *x, struct Room *y) 
 {
-	// If the names are the same, they are same room
-	// strcmp returns 0 if theyre same
-	if(strcmp(x->name, y->name) == 0)
+	// If the ids are the same, they are same room
+	if(x->id == y->id)
 	{
 		return true;
 	}
@@ -185,13 +543,17 @@ bool IsSameRoom(struct Room *x, struct Room *y)
 /***************************************************************************************
 * Connects both rooms to each other and increments counts
 ****************************************************************************************/
-void ConnectRoom(struct Room *x, struct Room *y) 
+void ConnectRoom(struct RoomGraph *graph, struct Room *x, struct Room *y) 
 {
+	// Rooms reaching 3 connections no longer hold up the graph
+	graph->numUnderFilled -= (x->numConnections == 2) + (y->numConnections == 2);
+	flipAdjacency(graph, x, y);
+
 	// Adds y as an outbound connection of x and increments
-	x->outboundConnections[x->numConnections] = y;
+	x->outboundConnections[x->numConnections] = y->id;
 	x->numConnections++;
 	// Vice versa
-	y->outboundConnections[y->numConnections] = x;
+	y->outboundConnections[y->numConnections] = x->id;
 	y->numConnections++;
 }
 
@@ -199,8 +561,10 @@ void ConnectRoom(struct Room *x, struct Room *y)
 /***************************************************************************************
 * Picks two random rooms, then connects them if valid
 ****************************************************************************************/
-void AddRandomConnection(struct Room *roomArray)  
+void AddRandomConnection(struct RoomGraph *graph, struct Random *random)
 {
+	struct Room *roomArray = graph->rooms;
+
 	// Pointers to Rooms
         struct Room *A;  
         struct Room *B;
@@ -208,85 +572,1014 @@ void AddRandomConnection(struct Room *roomArray)
 	// GETTING STUCK IN THIS LOOP
 
 	// Perform Loop until CanAddConnectionFrom A and B, Connection doesnt exist, and different rooms
+	uint64_t picks = 0;
         do
         {
-		A = GetRandomRoom(roomArray);
-  	        B = GetRandomRoom(roomArray);
+		A = GetRandomRoom(roomArray, random);
+  	        B = GetRandomRoom(roomArray, random);
+		picks++;
         }
         while(CanAddConnectionFrom(A) == false || CanAddConnectionFrom(B) == false ||
-	      IsSameRoom(A, B) == true || ConnectionAlreadyExists(A, B) == true);
+	      IsSameRoom(A, B) == true || ConnectionAlreadyExists(graph, A, B) == true);
+	STATS_COUNT(COUNTER_ROOM_PICKS, picks);
+	STATS_COUNT(COUNTER_PICK_RETRIES, picks - 1);
 
-        ConnectRoom(A, B);  
+        ConnectRoom(graph, A, B);  
        
 	 // Shouldnt need this line, I wrote it to go both ways
         //ConnectRoom(B, A);  //  because this A and B will be destroyed when this function terminates
 }
 
+/***************************************************************************************
+* Removes the connection between two rooms in both directions
+****************************************************************************************/
+void DisconnectRoom(struct RoomGraph *graph, struct Room *x, struct Room *y)
+{
+	graph->numUnderFilled += (x->numConnections == 3) + (y->numConnections == 3);
+	flipAdjacency(graph, x, y);
+
+	int i;
+	// Overwrite y with last connection of x
+	for(i = 0; i < x->numConnections; i++)
+	{
+		if(x->outboundConnections[i] == y->id)
+		{
+			x->numConnections--;
+			x->outboundConnections[i] = x->outboundConnections[x->numConnections];
+			break;
+		}
+	}
+	// Vice versa
+	for(i = 0; i < y->numConnections; i++)
+	{
+		if(y->outboundConnections[i] == x->id)
+		{
+			y->numConnections--;
+			y->outboundConnections[i] = y->outboundConnections[y->numConnections];
+			break;
+		}
+	}
+}
+
+/***************************************************************************************
+* Fills pool with every room index
+****************************************************************************************/
+void initializePool(struct RoomPool *pool)
+{
+	pool->rooms = malloc(sizeof(int) * NUM_ROOMS);
+	pool->position = malloc(sizeof(int) * NUM_ROOMS);
+	if(pool->rooms == NULL || pool->position == NULL)
+	{
+		perror("malloc");
+		exit(1);
+	}
+
+	int x;
+	for(x = 0; x < NUM_ROOMS; x++)
+	{
+		pool->rooms[x] = x;
+		pool->position[x] = x;
+	}
+	pool->count = NUM_ROOMS;
+}
+
+/***************************************************************************************
+* Removes room from pool by swapping last element into its place, does nothing
+* if the room was already removed
+****************************************************************************************/
+void removeFromPool(struct RoomPool *pool, int room)
+{
+	int index = pool->position[room];
+	if(index < 0)
+		return;
+
+	// Move last room into the hole left behind
+	int last = pool->rooms[pool->count - 1];
+	pool->rooms[index] = last;
+	pool->position[last] = index;
+	pool->position[room] = -1;
+	pool->count--;
+}
+
+/***************************************************************************************
+* Frees memory held by pool
+****************************************************************************************/
+void destroyPool(struct RoomPool *pool)
+{
+	free(pool->rooms);
+	free(pool->position);
+	pool->rooms = NULL;
+	pool->position = NULL;
+	pool->count = 0;
+}
+
+/***************************************************************************************
+* Takes a room out of the needy pool once it reaches 3 connections and out of the
+* open pool once it reaches 6
+****************************************************************************************/
+void updatePools(struct Room *x, struct RoomPool *needy, struct RoomPool *open)
+{
+	if(x->numConnections >= 3)
+		removeFromPool(needy, x->id);
+	if(CanAddConnectionFrom(x) == false)
+		removeFromPool(open, x->id);
+}
+
+/***************************************************************************************
+* Used when every room A could connect to is full. Some full room C is not connected
+* to A, so one of C's connections D gets rewired: C-D becomes A-C and A-D. C and D keep
+* their number of connections and A gains two.
+****************************************************************************************/
+void SwapInConnections(struct RoomGraph *graph, struct Room *A, struct RoomPool *needy, struct RoomPool *open)
+{
+	struct Room *roomArray = graph->rooms;
+
+	// A has at most 2 connections so at least 4 rooms are not connected to it, and
+	// since nothing was open all of those are full
+	struct Room *C = NULL;
+	int x;
+	for(x = 0; x < NUM_ROOMS && C == NULL; x++)
+	{
+		if(IsSameRoom(A, &roomArray[x]) == false && ConnectionAlreadyExists(graph, A, &roomArray[x]) == false)
+			C = &roomArray[x];
+	}
+
+	// C has 6 connections and at most 2 of them are also connected to A
+	struct Room *D = NULL;
+	for(x = 0; x < C->numConnections && D == NULL; x++)
+	{
+		if(ConnectionAlreadyExists(graph, A, &roomArray[C->outboundConnections[x]]) == false)
+			D = &roomArray[C->outboundConnections[x]];
+	}
+
+	DisconnectRoom(graph, C, D);
+	ConnectRoom(graph, A, C);
+	ConnectRoom(graph, A, D);
+	STATS_COUNT(COUNTER_SWAPS, 1);
+	updatePools(A, needy, open);
+}
+
+/***************************************************************************************
+* Connects every room in O(rooms + connections). Each step takes a room that still
+* needs connections and pairs it with a random room from the pool of rooms that still
+* have space. Rooms leave the pools as they fill, so picks never land on full rooms.
+****************************************************************************************/
+void BuildRandomGraph(struct RoomGraph *graph, struct Random *random)
+{
+	struct Room *roomArray = graph->rooms;
+	struct RoomPool needy;  // Rooms with fewer than 3 connections
+	struct RoomPool open;   // Rooms with fewer than 6 connections
+	initializePool(&needy);
+	initializePool(&open);
+	uint64_t picks = 0, retries = 0;	// Counted here and added once, not per pick
+
+	while(needy.count > 0)
+	{
+		struct Room *A = &roomArray[needy.rooms[randomBelow(random, needy.count)]];
+		struct Room *B = NULL;
+
+		// A random open room almost always works, only retry a few times
+		int tries;
+		for(tries = 0; tries < 16 && B == NULL; tries++)
+		{
+			struct Room *candidate = &roomArray[open.rooms[randomBelow(random, open.count)]];
+			if(IsSameRoom(A, candidate) == false && ConnectionAlreadyExists(graph, A, candidate) == false)
+				B = candidate;
+		}
+		picks += tries;
+		retries += tries - (B != NULL);
+
+		// Nearly full graphs can run out of luck, check every open room
+		int x;
+		for(x = 0; x < open.count && B == NULL; x++)
+		{
+			struct Room *candidate = &roomArray[open.rooms[x]];
+			if(IsSameRoom(A, candidate) == false && ConnectionAlreadyExists(graph, A, candidate) == false)
+				B = candidate;
+		}
+
+		if(B != NULL)
+		{
+			ConnectRoom(graph, A, B);
+			updatePools(A, &needy, &open);
+			updatePools(B, &needy, &open);
+		}
+		else
+		{
+			SwapInConnections(graph, A, &needy, &open);
+		}
+	}
+
+	destroyPool(&needy);
+	destroyPool(&open);
+	STATS_COUNT(COUNTER_ROOM_PICKS, picks);
+	STATS_COUNT(COUNTER_PICK_RETRIES, retries);
+}
+
 /***************************************************************************************
 * Diplays rooms and information about them, for troubleshooting
 ****************************************************************************************/
 void displayRooms(struct Room *roomArray)
 {
+	char name[9];
 	int x;
 	for(x = 0; x < NUM_ROOMS; x++)
 	{
 		printf("Name: %s\tType: %s\tNumber of Connections: %i\n", 
-		       roomArray[x].name, roomArray[x].type, roomArray[x].numConnections);
+		       getRoomName(&roomArray[x], name), roomTypeName(roomArray[x].type), roomArray[x].numConnections);
 	}
 }
 
 /***************************************************************************************
-* Creates directories, room files, and outputs information to them
+* Names the directory of a world and makes the temporary one it is written in. Single
+* worlds go in kuskc.rooms.<pid>, bulk world k goes in kuskc.rooms.<pid>.<k>, and
+* both are written in kuskc.tmp.<pid>[.<k>] first, which adventure never looks at.
+* directoryName and tempName must hold 64 characters.
 ****************************************************************************************/
-void createDirectoryAndFiles(struct Room *roomArray)
+bool makeTempDirectory(int worldNumber, char *tempName, char *directoryName)
 {
-	// CREATE DIRECTORY
-	
 	// Gets process ID of program
 	pid_t PID = getpid();
 
-	// String that will hold directory name and file names
-	char directoryName[20];
-	char fileName[30];  // Needs to be longer (holds directory name)
-
 	// Initializes array to null terminators
-	memset(directoryName, '\0', 20);
+	memset(directoryName, '\0', 64);
 
 	// Concatenates kuskc.rooms. with the process ID
-	sprintf(directoryName, "kuskc.rooms.%d", PID);
+	if(worldNumber < 0)
+	{
+		sprintf(directoryName, "kuskc.rooms.%d", PID);
+		sprintf(tempName, "kuskc.tmp.%d", PID);
+	}
+	else
+	{
+		sprintf(directoryName, "kuskc.rooms.%d.%d", PID, worldNumber);
+		sprintf(tempName, "kuskc.tmp.%d.%d", PID, worldNumber);
+	}
 
 	// Creates directory
-	int makeDirectory = mkdir(directoryName, 0755);
+	if(mkdir(tempName, 0755) < 0)
+	{
+		perror(tempName);
+		return false;
+	}
+	return true;
+}
+
+/***************************************************************************************
+* Renames tempName to directoryName once everything in it was created, so a reader
+* sees all of a world or none of it. A world that was not created is removed instead.
+****************************************************************************************/
+bool placeDirectory(const char *tempName, const char *directoryName, bool created)
+{
+	if(created && SYNC_POLICY >= SYNC_ALL)
+		created = syncDirectory(tempName);
+
+	// Fails rather than replace a world left by an earlier process with the same pid
+	if(created && rename(tempName, directoryName) < 0)
+	{
+		perror(directoryName);
+		created = false;
+	}
+	if(!created)
+	{
+		removeDirectory(tempName);
+		return false;
+	}
+	return SYNC_POLICY < SYNC_ALL || syncDirectory(".");
+}
+
+/***************************************************************************************
+* Creates directory and writes rooms in the requested formats, see makeTempDirectory
+* and placeDirectory. The name used is copied into directoryName, which must hold 64
+* characters.
+****************************************************************************************/
+bool createDirectoryAndFiles(struct Room *roomArray, int format, int worldNumber, char *directoryName)
+{
+	// CREATE DIRECTORY
+	char tempName[64];
+	if(!makeTempDirectory(worldNumber, tempName, directoryName))
+		return false;
 
 	// CREATE FILES
+	bool created = true;
+	if(format & FORMAT_TEXT)
+		created = createRoomFiles(roomArray, tempName);
+	if(created && (format & (FORMAT_BINARY | FORMAT_SOURCE)))
+		created = createWorldFile(roomArray, tempName, format, worldNumber);
+	return placeDirectory(tempName, directoryName, created);
+}
+
+/***************************************************************************************
+* Writes length bytes of data to fileName in the directory open as dirFd, then fsyncs
+* it if SYNC_POLICY says to. directoryName is only used in messages.
+****************************************************************************************/
+bool writeFile(int dirFd, const char *directoryName, const char *fileName, const char *data, size_t length)
+{
+	int fd = openat(dirFd, fileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	bool written = fd >= 0;
+
+	// write may stop early, keep going until everything is out
+	while(written && length > 0)
+	{
+		ssize_t count = write(fd, data, length);
+		written = count >= 0;
+		if(written)
+		{
+			data += count;
+			length -= count;
+		}
+	}
+	if(written && SYNC_POLICY >= SYNC_FILES)
+		written = fsync(fd) == 0;
+	if(fd >= 0 && close(fd) < 0)
+		written = false;
+	STATS_COUNT(COUNTER_FILES_WRITTEN, written);
+
+	if(!written)
+		fprintf(stderr, "%s/%s: %s\n", directoryName, fileName, strerror(errno));
+	return written;
+}
+
+/***************************************************************************************
+* Flushes a directory's entries to disk, so files created or renamed in it stay put
+****************************************************************************************/
+bool syncDirectory(const char *directoryName)
+{
+	int fd = open(directoryName, O_RDONLY | O_DIRECTORY);
+	if(fd < 0 || fsync(fd) < 0)
+	{
+		perror(directoryName);
+		if(fd >= 0)
+			close(fd);
+		return false;
+	}
+	close(fd);
+	return true;
+}
+
+/***************************************************************************************
+* Makes NUM_ROOMS rooms from random and connects them, NULL if out of memory. The
+* caller frees the rooms.
+****************************************************************************************/
+struct Room *connectRooms(struct Random *random, bool useLegacy)
+{
+	// Too many rooms for the stack once the world gets large
+	struct Room *roomArray = malloc(sizeof(struct Room) * NUM_ROOMS);
+	if (roomArray == NULL)
+	{
+		perror("malloc");
+		return NULL;
+	}
+
+	// Initializes the room structs
+	initializeRooms(roomArray, random);
+	uint64_t start = STATS_NOW();
+	struct RoomGraph graph;
+	if (!initializeGraph(&graph, roomArray))
+	{
+		free(roomArray);
+		return NULL;
+	}
+
+	// Create all connections in graph
+	if (useLegacy)
+	{
+		while (IsGraphFull(&graph) == false)
+		{
+			AddRandomConnection(&graph, random);
+		}
+	}
+	else
+	{
+		BuildRandomGraph(&graph, random);
+	}
+	destroyGraph(&graph);
+	STATS_TIMER(TIMER_CONNECT_ROOMS, start);
+	return roomArray;
+}
+
+/***************************************************************************************
+* Builds one world from random and writes it out, see createDirectoryAndFiles
+****************************************************************************************/
+bool generateWorld(struct Random *random, bool useLegacy, int format, int worldNumber, char *directoryName)
+{
+	struct Room *roomArray = connectRooms(random, useLegacy);
+	if (roomArray == NULL)
+		return false;
+
+	// Creates directory and room files, or adds the world to the archive
+	bool created;
+	if(format == FORMAT_ARCHIVE)
+	{
+		strcpy(directoryName, WORLD_ARCHIVE_NAME);
+		created = createWorldFile(roomArray, NULL, format, worldNumber);
+	}
+	else
+		created = createDirectoryAndFiles(roomArray, format, worldNumber, directoryName);
+	free(roomArray);
+	if(created)
+		STATS_COUNT(COUNTER_WORLDS, 1);
+	return created;
+}
+
+/***************************************************************************************
+* Builds world worldNumber into built, formatted in memory so writing it is only file
+* operations. World k always uses stream k of the master seed, so which thread builds
+* it does not matter.
+****************************************************************************************/
+bool buildBulkWorld(struct BulkJob *job, int worldNumber, struct BulkWorld *built)
+{
+	memset(built, 0, sizeof(*built));
+	built->worldNumber = worldNumber;
+
+	struct Random random;
+	seedRandom(&random, job->seed, worldNumber);
+	built->rooms = connectRooms(&random, job->useLegacy);
+	if(built->rooms == NULL)
+		return false;
+	if((job->format & FORMAT_TEXT) && !formatRoomFiles(built))
+		return false;
+
+	// Directory is only named here for messages, the writer makes it
+	char directoryName[64];
+	if(job->format == FORMAT_ARCHIVE)
+		strcpy(directoryName, WORLD_ARCHIVE_NAME);
+	else
+		sprintf(directoryName, "kuskc.rooms.%d.%d", (int)getpid(), worldNumber);
+	return !(job->format & (FORMAT_BINARY | FORMAT_SOURCE | FORMAT_ARCHIVE)) ||
+	       packWorld(built->rooms, &built->world, directoryName);
+}
+
+/***************************************************************************************
+* Writes a world made by buildBulkWorld, see createDirectoryAndFiles
+****************************************************************************************/
+bool writeBulkWorld(struct BulkJob *job, struct BulkWorld *built)
+{
+	bool created;
+	uint64_t start;
+	if(job->format == FORMAT_ARCHIVE)
+	{
+		start = STATS_NOW();
+		created = saveWorld(&built->world, NULL, job->format, built->worldNumber);
+		STATS_TIMER(TIMER_WORLD_FILE, start);
+	}
+	else
+	{
+		char directoryName[64], tempName[64];
+		created = makeTempDirectory(built->worldNumber, tempName, directoryName);
+		if(created)
+		{
+			if(built->roomFiles != NULL)
+				created = writeRoomFiles(built, tempName);
+			if(created && built->world.base != NULL)
+			{
+				start = STATS_NOW();
+				created = saveWorld(&built->world, tempName, job->format, built->worldNumber);
+				STATS_TIMER(TIMER_WORLD_FILE, start);
+			}
+			created = placeDirectory(tempName, directoryName, created);
+		}
+	}
+	if(created)
+		STATS_COUNT(COUNTER_WORLDS, 1);
+	else
+		fprintf(stderr, "World %d could not be written\n", built->worldNumber);
+	return created;
+}
+
+/***************************************************************************************
+* Frees what buildBulkWorld held, built itself belongs to the caller
+****************************************************************************************/
+void freeBulkWorld(struct BulkWorld *built)
+{
+	free(built->rooms);
+	free(built->roomFiles);
+	free(built->roomFileEnds);
+	if(built->world.base != NULL)
+		worldClose(&built->world);
+}
+
+/***************************************************************************************
+* Bulk generation thread, builds worlds until none are left and hands each to the
+* writer, waiting while job->maxBuffered worlds are already held
+****************************************************************************************/
+void *bulkWorker(void *arguments)
+{
+	struct BulkJob *job = arguments;
+
+	for(;;)
+	{
+		pthread_mutex_lock(&job->lock);
+		int worldNumber = job->nextWorld++;
+		pthread_mutex_unlock(&job->lock);
+		if(worldNumber >= job->numWorlds)
+			break;
+
+		struct BulkWorld *built = malloc(sizeof(struct BulkWorld));
+		bool made = built != NULL && buildBulkWorld(job, worldNumber, built);
+		if(made && job->writeInline)
+			made = writeBulkWorld(job, built);
+		if(!made || job->writeInline)
+		{
+			if(built != NULL)
+			{
+				freeBulkWorld(built);
+				free(built);
+			}
+			else
+				perror("malloc");
+			if(!made)
+			{
+				pthread_mutex_lock(&job->lock);
+				job->failures++;
+				pthread_mutex_unlock(&job->lock);
+			}
+			continue;
+		}
+
+		pthread_mutex_lock(&job->lock);
+		while(job->numBuffered >= job->maxBuffered)
+			pthread_cond_wait(&job->space, &job->lock);
+		built->next = NULL;
+		if(job->last != NULL)
+			job->last->next = built;
+		else
+			job->first = built;
+		job->last = built;
+		job->numBuffered++;
+		pthread_cond_signal(&job->ready);
+		pthread_mutex_unlock(&job->lock);
+	}
+
+	pthread_mutex_lock(&job->lock);
+	job->numBuilders--;
+	pthread_cond_signal(&job->ready);
+	pthread_mutex_unlock(&job->lock);
+	return NULL;
+}
+
+/***************************************************************************************
+* Writes worlds as the builders finish them, until every builder is done. Each pass
+* takes every buffered world at once, so builders are not held up by the lock while
+* files are written.
+****************************************************************************************/
+void writeBulk(struct BulkJob *job)
+{
+	pthread_mutex_lock(&job->lock);
+	for(;;)
+	{
+		while(job->first == NULL && job->numBuilders > 0)
+			pthread_cond_wait(&job->ready, &job->lock);
+		struct BulkWorld *batch = job->first;
+		if(batch == NULL)
+			break;
+		job->first = NULL;
+		job->last = NULL;
+		pthread_mutex_unlock(&job->lock);
+
+		int failures = 0;
+		while(batch != NULL)
+		{
+			struct BulkWorld *next = batch->next;
+			failures += !writeBulkWorld(job, batch);
+			freeBulkWorld(batch);
+			free(batch);
+			batch = next;
+
+			// Room for one more world as soon as this one is freed
+			pthread_mutex_lock(&job->lock);
+			job->numBuffered--;
+			job->failures += failures;
+			failures = 0;
+			pthread_cond_signal(&job->space);
+			pthread_mutex_unlock(&job->lock);
+		}
+		pthread_mutex_lock(&job->lock);
+	}
+	pthread_mutex_unlock(&job->lock);
+}
+
+/***************************************************************************************
+* Builds numWorlds worlds on numThreads threads while the calling thread writes them,
+* then publishes the last one
+****************************************************************************************/
+bool generateBulk(uint64_t seed, int numWorlds, int numThreads, bool useLegacy, int format)
+{
+	struct BulkJob job;
+	job.seed = seed;
+	job.numWorlds = numWorlds;
+	job.useLegacy = useLegacy;
+	job.format = format;
+	job.writeInline = false;
+	job.nextWorld = 0;
+	job.failures = 0;
+	job.numBuilders = 0;
+	job.numBuffered = 0;
+	job.first = NULL;
+	job.last = NULL;
+	pthread_mutex_init(&job.lock, NULL);
+	pthread_cond_init(&job.ready, NULL);
+	pthread_cond_init(&job.space, NULL);
+
+	if(numThreads > numWorlds)
+		numThreads = numWorlds;
+	// Two worlds a builder keeps it busy while the writer catches up, and bounds memory
+	job.maxBuffered = numThreads * 2;
+	pthread_t *threads = malloc(sizeof(pthread_t) * numThreads);
+	if(threads == NULL)
+	{
+		perror("malloc");
+		return false;
+	}
+
+	// Builders are counted before any starts, so the writer can not finish early
+	int x, started = 0;
+	job.numBuilders = numThreads;
+	for(x = 0; x < numThreads; x++)
+	{
+		if(pthread_create(&threads[started], NULL, bulkWorker, &job) == 0)
+			started++;
+	}
+	pthread_mutex_lock(&job.lock);
+	job.numBuilders -= numThreads - started;
+	pthread_mutex_unlock(&job.lock);
+
+	if(started > 0)
+		writeBulk(&job);
+	else
+	{
+		// Calling thread does everything, so bulk builds still finish
+		job.writeInline = true;
+		job.numBuilders = 1;
+		bulkWorker(&job);
+	}
+	for(x = 0; x < started; x++)
+		pthread_join(threads[x], NULL);
+	free(threads);
+	pthread_cond_destroy(&job.ready);
+	pthread_cond_destroy(&job.space);
+	pthread_mutex_destroy(&job.lock);
+
+	printf("Built %d worlds with seed %" PRIu64 "\n", numWorlds - job.failures, seed);
+	if(job.failures > 0)
+	{
+		fprintf(stderr, "%d worlds could not be written\n", job.failures);
+		return false;
+	}
+	if(format == FORMAT_ARCHIVE)
+		return true;
+
+	// Last world becomes the one adventure plays
+	char directoryName[64];
+	uint64_t sequence;
+	sprintf(directoryName, "kuskc.rooms.%d.%d", (int)getpid(), numWorlds - 1);
+	return worldPublish(directoryName, &sequence);
+}
+
+/***************************************************************************************
+* Writes the text file of room x into contents, which must hold ROOM_FILE_SIZE
+* characters, and returns its length
+****************************************************************************************/
+int formatRoomFile(const struct Room *roomArray, int x, char *contents)
+{
+	char name[9];
+
+	// Output room name
+	int length = sprintf(contents, "ROOM NAME: %s\n", getRoomName(&roomArray[x], name));
+
+	// Loop through every connection
+	int i;
+	for(i = 0; i < roomArray[x].numConnections; i++)
+	{
+		// Output every outbound connection room name
+		length += sprintf(contents + length, "CONNECTION %i: %s\n", i+1,
+		                  getRoomName(&roomArray[roomArray[x].outboundConnections[i]], name));
+	}
+
+	// Output room type
+	length += sprintf(contents + length, "ROOM TYPE: %s\n", roomTypeName(roomArray[x].type));
+	return length;
+}
+
+/***************************************************************************************
+* Creates one text file per room and outputs information to them, false if any file
+* could not be written. Each file is formatted in memory and written in one go.
+****************************************************************************************/
+bool createRoomFiles(struct Room *roomArray, const char *directoryName)
+{
+	char contents[ROOM_FILE_SIZE];
+	char name[9];
+
+	uint64_t start = STATS_NOW();
+
+	// Files are opened relative to the directory, so its path is only looked up once
+	int dirFd = open(directoryName, O_RDONLY | O_DIRECTORY);
+	if(dirFd < 0)
+	{
+		perror(directoryName);
+		return false;
+	}
 
 	// Loop through every element of array, making file for each
 	int x;
 	for(x = 0; x < NUM_ROOMS; x++)
 	{
-		// Resets fileName everytime through
-		memset(fileName, '\0', 30);
-		// Creates file name like /directoryName/fileName
-		sprintf(fileName, "%s/%s", directoryName, roomArray[x].name);
-
-	
-		FILE* myFile = fopen(fileName, "w");	
-	
-		// Output room name
-		fprintf(myFile, "ROOM NAME: %s\n", roomArray[x].name);
-		
-		// Loop through every connection
-		int i;
+		int length = formatRoomFile(roomArray, x, contents);
+		if(!writeFile(dirFd, directoryName, getRoomName(&roomArray[x], name), contents, length))
+		{
+			close(dirFd);
+			return false;
+		}
+		STATS_COUNT(COUNTER_BYTES_WRITTEN, length);
+	}
+	close(dirFd);
+	STATS_TIMER(TIMER_ROOM_FILES, start);
+	return true;
+}
+
+/***************************************************************************************
+* Formats the text file of every room of built into one buffer, so the writer only
+* has to create files. False if out of memory.
+****************************************************************************************/
+bool formatRoomFiles(struct BulkWorld *built)
+{
+	// Room files are about 100 bytes, grow if a world has longer ones
+	size_t size = (size_t)NUM_ROOMS * 128;
+	size_t length = 0;
+	built->roomFiles = malloc(size);
+	built->roomFileEnds = malloc(sizeof(size_t) * NUM_ROOMS);
+	if(built->roomFiles == NULL || built->roomFileEnds == NULL)
+	{
+		perror("malloc");
+		return false;
+	}
+
+	int x;
+	for(x = 0; x < NUM_ROOMS; x++)
+	{
+		if(size - length < ROOM_FILE_SIZE)
+		{
+			char *bigger = realloc(built->roomFiles, size * 2);
+			if(bigger == NULL)
+			{
+				perror("realloc");
+				return false;
+			}
+			built->roomFiles = bigger;
+			size *= 2;
+		}
+		length += formatRoomFile(built->rooms, x, built->roomFiles + length);
+		built->roomFileEnds[x] = length;
+	}
+	return true;
+}
+
+/***************************************************************************************
+* Writes the room files formatRoomFiles made into directoryName, one write each
+****************************************************************************************/
+bool writeRoomFiles(const struct BulkWorld *built, const char *directoryName)
+{
+	char name[9];
+
+	uint64_t start = STATS_NOW();
+	int dirFd = open(directoryName, O_RDONLY | O_DIRECTORY);
+	if(dirFd < 0)
+	{
+		perror(directoryName);
+		return false;
+	}
+
+	int x;
+	size_t begin = 0;
+	for(x = 0; x < NUM_ROOMS; x++)
+	{
+		size_t length = built->roomFileEnds[x] - begin;
+		if(!writeFile(dirFd, directoryName, getRoomName(&built->rooms[x], name),
+		              built->roomFiles + begin, length))
+		{
+			close(dirFd);
+			return false;
+		}
+		STATS_COUNT(COUNTER_BYTES_WRITTEN, length);
+		begin = built->roomFileEnds[x];
+	}
+	close(dirFd);
+	STATS_TIMER(TIMER_ROOM_FILES, start);
+	return true;
+}
+
+/***************************************************************************************
+* Packs every room into world, see kuskc.world.h, with distances to END worked out.
+* label names the world in messages. False if the world could not be built.
+****************************************************************************************/
+bool packWorld(struct Room *roomArray, struct World *world, const char *label)
+{
+	char name[9];
+
+	// Count sizes of targets and string pool
+	uint32_t numConnections = 0;
+	uint32_t stringPoolSize = 0;
+	int x, i;
+	for(x = 0; x < NUM_ROOMS; x++)
+	{
+		numConnections += roomArray[x].numConnections;
+		stringPoolSize += strlen(getRoomName(&roomArray[x], name)) + 1;
+	}
+
+	if(!worldCreate(world, NUM_ROOMS, numConnections, stringPoolSize))
+		return false;
+
+	// Sections are read only once the world is built, fill them through writable pointers
+	struct WorldHeader *header = world->base;
+	uint32_t *offsets = (uint32_t*)world->offsets;
+	uint32_t *targets = (uint32_t*)world->targets;
+	uint32_t *names = (uint32_t*)world->names;
+	char *strings = (char*)world->strings;
+
+	uint32_t nextConnection = 0;
+	uint32_t nextString = 0;
+	for(x = 0; x < NUM_ROOMS; x++)
+	{
+		if(roomArray[x].type == START_ROOM)
+			header->startRoom = x;
+		else if(roomArray[x].type == END_ROOM)
+			header->endRoom = x;
+
+		// Room ids are already world room numbers, copy them straight across
+		offsets[x] = nextConnection;
 		for(i = 0; i < roomArray[x].numConnections; i++)
+			targets[nextConnection++] = roomArray[x].outboundConnections[i];
+
+		names[x] = nextString;
+		strcpy(strings + nextString, getRoomName(&roomArray[x], name));
+		nextString += strlen(strings + nextString) + 1;
+	}
+	offsets[NUM_ROOMS] = nextConnection;
+	if(!worldBuildIndex(world))
+	{
+		worldClose(world);
+		return false;
+	}
+
+	// Distances to END are stored so adventure never has to search
+	worldComputeDistances(world, DISTANCE_THREADS);
+	worldComputeDiameter(world);
+	if(header->unreachableRooms > 0)
+		fprintf(stderr, "%s: %u rooms can not reach END_ROOM\n", label, header->unreachableRooms);
+	return true;
+}
+
+/***************************************************************************************
+* Saves world as a binary world file, C source or both in directoryName as format
+* says. Archive worlds have no directory and are appended to WORLD_ARCHIVE_NAME under
+* stream worldNumber of the master seed. False if the world could not be saved.
+****************************************************************************************/
+bool saveWorld(const struct World *world, const char *directoryName, int format, int worldNumber)
+{
+	char fileName[80];
+	bool saved = true;
+	if(format & FORMAT_BINARY)
+	{
+		sprintf(fileName, "%s/%s", directoryName, WORLD_FILE_NAME);
+		saved = worldSave(world, fileName, SYNC_POLICY >= SYNC_FILES);
+	}
+	if(saved && (format & FORMAT_SOURCE))
+	{
+		sprintf(fileName, "%s/%s", directoryName, WORLD_SOURCE_NAME);
+		saved = worldSaveSource(world, fileName, SYNC_POLICY >= SYNC_FILES);
+	}
+	if(format & FORMAT_ARCHIVE)
+	{
+		// Single worlds use stream 0, see main
+		uint64_t worldId;
+		saved = worldArchiveAppend(WORLD_ARCHIVE_NAME, world, MASTER_SEED, worldNumber < 0 ? 0 : worldNumber,
+		                           SYNC_POLICY >= SYNC_FILES, &worldId);
+		if(saved && worldNumber < 0)
+			printf("Added world %" PRIu64 " to %s\n", worldId, WORLD_ARCHIVE_NAME);
+	}
+	return saved;
+}
+
+/***************************************************************************************
+* Packs every room into a world and saves it, see packWorld and saveWorld
+****************************************************************************************/
+bool createWorldFile(struct Room *roomArray, const char *directoryName, int format, int worldNumber)
+{
+	uint64_t start = STATS_NOW();
+	struct World world;
+	if(!packWorld(roomArray, &world, directoryName != NULL ? directoryName : WORLD_ARCHIVE_NAME))
+		return false;
+	bool saved = saveWorld(&world, directoryName, format, worldNumber);
+	worldClose(&world);
+	STATS_TIMER(TIMER_WORLD_FILE, start);
+	return saved;
+}
+
+/***************************************************************************************
+* Sorts rooms directories newest first
+****************************************************************************************/
+int compareNewestFirst(const void *a, const void *b)
+{
+	const struct timespec *x = &((const struct WorldDirectory*)a)->modified;
+	const struct timespec *y = &((const struct WorldDirectory*)b)->modified;
+	if(x->tv_sec != y->tv_sec)
+		return x->tv_sec < y->tv_sec ? 1 : -1;
+	if(x->tv_nsec != y->tv_nsec)
+		return x->tv_nsec < y->tv_nsec ? 1 : -1;
+	return 0;
+}
+
+/***************************************************************************************
+* Deletes a rooms directory and the files in it, rooms directories have no subdirectories
+****************************************************************************************/
+bool removeDirectory(const char *directoryName)
+{
+	DIR *dirToRemove = opendir(directoryName);
+	if(dirToRemove == NULL)
+	{
+		perror(directoryName);
+		return false;
+	}
+
+	char fileName[300];
+	struct dirent *fileInDir;
+	while((fileInDir = readdir(dirToRemove)) != NULL)
+	{
+		if(!strcmp(fileInDir->d_name, ".") || !strcmp(fileInDir->d_name, ".."))
+			continue;
+		snprintf(fileName, sizeof(fileName), "%s/%s", directoryName, fileInDir->d_name);
+		unlink(fileName);
+	}
+	closedir(dirToRemove);
+
+	if(rmdir(directoryName) < 0)
+	{
+		perror(directoryName);
+		return false;
+	}
+	return true;
+}
+
+/***************************************************************************************
+* Deletes all but the keep newest rooms directories. The world named in the manifest
+* is never deleted. Returns number of directories deleted, or -1 on error.
+****************************************************************************************/
+int pruneWorlds(int keep)
+{
+	char latestName[256] = "";
+	uint64_t sequence;
+	worldLatest(latestName, sizeof(latestName), &sequence);
+
+	DIR *dirToCheck = opendir(".");
+	if(dirToCheck == NULL)
+	{
+		perror("opendir");
+		return -1;
+	}
+
+	// Collect every rooms directory with its modified time
+	int numWorlds = 0, capacity = 64;
+	struct WorldDirectory *worlds = malloc(sizeof(struct WorldDirectory) * capacity);
+	struct dirent *fileInDir;
+	struct stat dirAttributes;
+	while(worlds != NULL && (fileInDir = readdir(dirToCheck)) != NULL)
+	{
+		if(strncmp(fileInDir->d_name, "kuskc.rooms.", 12) != 0 || strlen(fileInDir->d_name) >= 256)
+			continue;
+		if(stat(fileInDir->d_name, &dirAttributes) < 0 || !S_ISDIR(dirAttributes.st_mode))
+			continue;
+
+		if(numWorlds == capacity)
 		{
-			// Output every outbound connection room name
-			fprintf(myFile, "CONNECTION %i: %s\n", i+1, 
-                                roomArray[x].outboundConnections[i]->name);
+			capacity *= 2;
+			struct WorldDirectory *grown = realloc(worlds, sizeof(struct WorldDirectory) * capacity);
+			if(grown == NULL)
+				free(worlds);
+			worlds = grown;
+			if(worlds == NULL)
+				break;
 		}
+		strcpy(worlds[numWorlds].name, fileInDir->d_name);
+		worlds[numWorlds].modified = dirAttributes.st_mtim;
+		numWorlds++;
+	}
+	closedir(dirToCheck);
 
-		// Output room type
-		fprintf(myFile, "ROOM TYPE: %s\n", roomArray[x].type);
-		
-		fclose(myFile);
+	if(worlds == NULL)
+	{
+		perror("malloc");
+		return -1;
+	}
+
+	qsort(worlds, numWorlds, sizeof(struct WorldDirectory), compareNewestFirst);
+
+	int x, removed = 0;
+	for(x = keep; x < numWorlds; x++)
+	{
+		if(strcmp(worlds[x].name, latestName) != 0 && removeDirectory(worlds[x].name))
+			removed++;
 	}
+
+	free(worlds);
+	return removed;
 }
@@ -0,0 +1,48 @@
+#!/bin/sh
+################################################################################
+#  Regression checks of adventure that need no player, run by make check.
+#
+#  Usage: sh kuskc.check.sh [BIN_DIR]
+#  BIN_DIR holds kuskc.buildrooms and kuskc.adventure (default .). Exits 1 on
+#  the first check that fails, naming it.
+################################################################################
+
+BIN_DIR=$(cd "${1:-.}" && pwd) || exit 1
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/kuskc.check.XXXXXX") || exit 1
+trap 'rm -rf "$WORK"' EXIT
+trap 'exit 1' INT TERM
+cd "$WORK" || exit 1
+
+fail()
+{
+	echo "$0: $1" >&2
+	exit 1
+}
+
+"$BIN_DIR/kuskc.buildrooms" -s 7 -n 50 -f text > /dev/null || fail "buildrooms failed"
+
+# START and a neighbour of it that is not END, read from the text room files
+startFile=$(grep -l '^ROOM TYPE: START_ROOM$' kuskc.rooms.*/*) || fail "no START room"
+start=$(sed -n 's/^ROOM NAME: //p' "$startFile")
+for next in $(sed -n 's/^CONNECTION [0-9]*: //p' "$startFile"); do
+	grep -q '^ROOM TYPE: END_ROOM$' kuskc.rooms.*/"$next" || break
+done
+
+# A batch session with no valid moves after a session that filled several path
+# chunks must report an empty path, not the rooms of the session before it
+moves=
+i=0
+while [ $i -lt 600 ]; do
+	moves="$moves $next $start"
+	i=$((i + 1))
+done
+printf '%s\nnothing\n' "$moves" > batch
+"$BIN_DIR/kuskc.adventure" -b batch > out 2> /dev/null || fail "batch replay exited with $?"
+[ "$(sed -n 2p out)" = "0 1 INCOMPLETE" ] || fail "empty session after a long one printed $(sed -n 2p out | cut -c1-60)"
+
+# The same after a session shorter than one chunk
+printf '%s\nnothing\n' "$next" > batch
+"$BIN_DIR/kuskc.adventure" -b batch > out 2> /dev/null || fail "batch replay exited with $?"
+[ "$(sed -n 2p out)" = "0 1 INCOMPLETE" ] || fail "empty session after a short one printed $(sed -n 2p out | cut -c1-60)"
+
+echo "All checks passed" >&2
@@ -0,0 +1,249 @@
+/********************************************************************************
+  Phase timers, counters and latency histograms, see kuskc.stats.h
+*********************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <inttypes.h>
+#include "kuskc.stats.h"
+
+#define HISTOGRAM_BUCKETS 976	// 16 exact buckets, then 16 for each power of two up to 2^63
+
+// Function Declarations
+static int bucketIndex(uint64_t);
+#ifdef KUSKC_STATS
+static uint64_t bucketLow(int);
+static uint64_t percentile(int, double);
+static void writeReport();
+static void *reportOnSignal(void*);
+#endif
+
+// Everything recorded so far, updated with relaxed atomics from any thread
+static uint64_t timerTotals[NUM_TIMERS];
+static uint64_t timerCounts[NUM_TIMERS];
+static uint64_t counters[NUM_COUNTERS];
+static uint64_t histograms[NUM_LATENCIES][HISTOGRAM_BUCKETS];
+static uint64_t latencyTotals[NUM_LATENCIES];
+static uint64_t latencyMax[NUM_LATENCIES];
+
+#ifdef KUSKC_STATS
+// Names used in the report, in enum order
+static const char *timerNames[NUM_TIMERS] = {"connect_rooms", "room_files", "world_file", "distances",
+	"diameter", "publish", "find_directory", "open_world", "read_rooms", "set_connections",
+	"resume"};
+static const char *counterNames[NUM_COUNTERS] = {"worlds", "room_picks", "pick_retries", "swaps",
+	"files_written", "bytes_written", "room_files_read", "rooms_read", "rooms_evicted"};
+static const char *latencyNames[NUM_LATENCIES] = {"move", "invalid", "time", "hint"};
+
+static const char *programName;
+static const char *reportFileName;	// "-" is stderr
+static pthread_mutex_t reportLock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/***************************************************************************************
+* Turns stats on. The report goes to fileName at exit and on every SIGUSR1.
+* Call before any other thread is started so they all leave SIGUSR1 to the report
+* thread. False if stats were compiled out or the report thread could not start.
+****************************************************************************************/
+bool statsStart(const char *program, const char *fileName)
+{
+#ifndef KUSKC_STATS
+	(void)program;
+	(void)fileName;
+	fprintf(stderr, "Built without KUSKC_STATS, rebuild with -DKUSKC_STATS for --stats\n");
+	return false;
+#else
+	programName = program;
+	reportFileName = fileName;
+
+	// Every thread started after this inherits the mask, so only sigwait sees SIGUSR1
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGUSR1);
+	pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+	pthread_t thread;
+	if(pthread_create(&thread, NULL, reportOnSignal, NULL) != 0)
+	{
+		fprintf(stderr, "Could not start stats thread\n");
+		return false;
+	}
+	pthread_detach(thread);
+	atexit(writeReport);
+	return true;
+#endif
+}
+
+/***************************************************************************************
+* Returns monotonic clock in nanoseconds
+****************************************************************************************/
+uint64_t statsNow()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/***************************************************************************************
+* Adds one run of a phase that took nanoseconds
+****************************************************************************************/
+void statsAddTime(enum StatsTimer timer, uint64_t nanoseconds)
+{
+	__atomic_fetch_add(&timerTotals[timer], nanoseconds, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&timerCounts[timer], 1, __ATOMIC_RELAXED);
+}
+
+/***************************************************************************************
+* Adds n to a counter
+****************************************************************************************/
+void statsAddCount(enum StatsCounter counter, uint64_t n)
+{
+	__atomic_fetch_add(&counters[counter], n, __ATOMIC_RELAXED);
+}
+
+/***************************************************************************************
+* Records one command that took nanoseconds
+****************************************************************************************/
+void statsRecordLatency(enum StatsLatency latency, uint64_t nanoseconds)
+{
+	__atomic_fetch_add(&histograms[latency][bucketIndex(nanoseconds)], 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&latencyTotals[latency], nanoseconds, __ATOMIC_RELAXED);
+
+	uint64_t highest = __atomic_load_n(&latencyMax[latency], __ATOMIC_RELAXED);
+	while(nanoseconds > highest &&
+	      !__atomic_compare_exchange_n(&latencyMax[latency], &highest, nanoseconds, true,
+	                                   __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+/***************************************************************************************
+* Returns histogram bucket of value. Values under 16 get their own bucket, above
+* that each power of two is split into 16 buckets by the next 4 bits.
+****************************************************************************************/
+static int bucketIndex(uint64_t value)
+{
+	if(value < 16)
+		return value;
+	int magnitude = 63 - __builtin_clzll(value);
+	return (magnitude - 3) * 16 + ((value >> (magnitude - 4)) & 15);
+}
+
+#ifdef KUSKC_STATS
+/***************************************************************************************
+* Returns smallest value that lands in bucket
+****************************************************************************************/
+static uint64_t bucketLow(int bucket)
+{
+	if(bucket < 16)
+		return bucket;
+	return (uint64_t)(16 + bucket % 16) << (bucket / 16 - 1);
+}
+
+/***************************************************************************************
+* Returns highest value in the bucket holding the given fraction of a latency's
+* samples, never more than the largest sample
+****************************************************************************************/
+static uint64_t percentile(int latency, double fraction)
+{
+	uint64_t total = 0, seen = 0;
+	int bucket;
+	for(bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++)
+		total += __atomic_load_n(&histograms[latency][bucket], __ATOMIC_RELAXED);
+
+	uint64_t wanted = total * fraction;
+	uint64_t highest = __atomic_load_n(&latencyMax[latency], __ATOMIC_RELAXED);
+	for(bucket = 0; bucket < HISTOGRAM_BUCKETS - 1; bucket++)
+	{
+		seen += __atomic_load_n(&histograms[latency][bucket], __ATOMIC_RELAXED);
+		if(seen > wanted)
+			break;
+	}
+	uint64_t value = bucketLow(bucket + 1) - 1;
+	return value < highest ? value : highest;
+}
+
+/***************************************************************************************
+* Writes everything recorded so far as one JSON object
+****************************************************************************************/
+static void writeReport()
+{
+	pthread_mutex_lock(&reportLock);
+	FILE *report = strcmp(reportFileName, "-") == 0 ? stderr : fopen(reportFileName, "w");
+	if(report == NULL)
+	{
+		perror(reportFileName);
+		pthread_mutex_unlock(&reportLock);
+		return;
+	}
+
+	int x;
+	fprintf(report, "{\"program\": \"%s\",\n \"timers\": {", programName);
+	for(x = 0; x < NUM_TIMERS; x++)
+		fprintf(report, "%s\n  \"%s\": {\"count\": %" PRIu64 ", \"total_ns\": %" PRIu64 "}", x ? "," : "",
+		        timerNames[x], __atomic_load_n(&timerCounts[x], __ATOMIC_RELAXED),
+		        __atomic_load_n(&timerTotals[x], __ATOMIC_RELAXED));
+	fprintf(report, "},\n \"counters\": {");
+	for(x = 0; x < NUM_COUNTERS; x++)
+		fprintf(report, "%s\n  \"%s\": %" PRIu64, x ? "," : "", counterNames[x],
+		        __atomic_load_n(&counters[x], __ATOMIC_RELAXED));
+	fprintf(report, "},\n \"latency\": {");
+	for(x = 0; x < NUM_LATENCIES; x++)
+	{
+		uint64_t count = 0;
+		int bucket;
+		for(bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++)
+			count += __atomic_load_n(&histograms[x][bucket], __ATOMIC_RELAXED);
+		uint64_t total = __atomic_load_n(&latencyTotals[x], __ATOMIC_RELAXED);
+
+		fprintf(report, "%s\n  \"%s\": {\"count\": %" PRIu64 ", \"mean_ns\": %" PRIu64, x ? "," : "",
+		        latencyNames[x], count, count ? total / count : 0);
+		fprintf(report, ", \"p50_ns\": %" PRIu64 ", \"p90_ns\": %" PRIu64 ", \"p99_ns\": %" PRIu64
+		        ", \"p999_ns\": %" PRIu64 ", \"max_ns\": %" PRIu64,
+		        percentile(x, 0.5), percentile(x, 0.9), percentile(x, 0.99), percentile(x, 0.999),
+		        __atomic_load_n(&latencyMax[x], __ATOMIC_RELAXED));
+
+		// Non-empty buckets only, as [lowest value, samples]
+		fprintf(report, ", \"buckets\": [");
+		bool first = true;
+		for(bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++)
+		{
+			uint64_t samples = __atomic_load_n(&histograms[x][bucket], __ATOMIC_RELAXED);
+			if(samples == 0)
+				continue;
+			fprintf(report, "%s[%" PRIu64 ", %" PRIu64 "]", first ? "" : ", ", bucketLow(bucket), samples);
+			first = false;
+		}
+		fprintf(report, "]}");
+	}
+	fprintf(report, "}}\n");
+
+	if(report == stderr)
+		fflush(report);
+	else if(fclose(report) != 0)
+		perror(reportFileName);
+	pthread_mutex_unlock(&reportLock);
+}
+
+/***************************************************************************************
+* Report thread, writes the report every time SIGUSR1 arrives
+****************************************************************************************/
+static void *reportOnSignal(void *arguments)
+{
+	(void)arguments;
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGUSR1);
+
+	int signalNumber;
+	for(;;)
+	{
+		if(sigwait(&signals, &signalNumber) == 0)
+			writeReport();
+	}
+	return NULL;
+}
+#endif
@@ -0,0 +1,81 @@
+/********************************************************************************
+  Phase timers, counters and latency histograms shared by buildrooms and
+  adventure. Everything is compiled out unless KUSKC_STATS is defined, in which
+  case the STATS_ macros below cost one clock read or one atomic add each.
+
+  Latencies go into log-linear histograms: 16 buckets per power of two, so any
+  value is off by at most 1/16 from the bucket it lands in, like HdrHistogram
+  with one significant hex digit.
+
+  After statsStart everything is reported as JSON to a file when the program
+  exits, and again every time the process gets SIGUSR1.
+*********************************************************************************/
+
+#ifndef KUSKC_STATS_H
+#define KUSKC_STATS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Phases timed from start to finish, summed over every time they run
+enum StatsTimer
+{
+	TIMER_CONNECT_ROOMS,        // Building the graph of one world
+	TIMER_ROOM_FILES,           // Writing text room files
+	TIMER_WORLD_FILE,           // Packing and saving world.bin
+	TIMER_DISTANCES,            // BFS from END
+	TIMER_DIAMETER,
+	TIMER_PUBLISH,              // Updating the manifest
+	TIMER_FIND_DIRECTORY,
+	TIMER_OPEN_WORLD,           // Mapping world.bin
+	TIMER_READ_ROOMS,           // Reading and parsing text room files
+	TIMER_SET_CONNECTIONS,
+	TIMER_RESUME,               // Reading a checkpoint back
+	NUM_TIMERS
+};
+
+// Event counts
+enum StatsCounter
+{
+	COUNTER_WORLDS,             // Worlds built
+	COUNTER_ROOM_PICKS,         // Random room pairs tried while connecting
+	COUNTER_PICK_RETRIES,       // Pairs that could not be connected
+	COUNTER_SWAPS,              // SwapInConnections rewires
+	COUNTER_FILES_WRITTEN,
+	COUNTER_BYTES_WRITTEN,
+	COUNTER_ROOM_FILES_READ,
+	COUNTER_ROOMS_READ,         // Rooms read into a WorldCache
+	COUNTER_ROOMS_EVICTED,      // Rooms dropped from a full WorldCache
+	NUM_COUNTERS
+};
+
+// Commands whose latency is recorded
+enum StatsLatency
+{
+	LATENCY_MOVE,
+	LATENCY_INVALID,            // Input that was not a connected room
+	LATENCY_TIME,               // Includes the round trip to the time thread
+	LATENCY_HINT,
+	NUM_LATENCIES
+};
+
+#ifdef KUSKC_STATS
+#define STATS_NOW() statsNow()
+#define STATS_TIMER(timer, start) statsAddTime((timer), statsNow() - (start))
+#define STATS_COUNT(counter, n) statsAddCount((counter), (n))
+#define STATS_LATENCY(latency, start) statsRecordLatency((latency), statsNow() - (start))
+#else
+#define STATS_NOW() ((uint64_t)0)
+#define STATS_TIMER(timer, start) ((void)(start))
+#define STATS_COUNT(counter, n) ((void)(n))
+#define STATS_LATENCY(latency, start) ((void)(start))
+#endif
+
+// Function Declarations
+bool statsStart(const char*, const char*);
+uint64_t statsNow();
+void statsAddTime(enum StatsTimer, uint64_t);
+void statsAddCount(enum StatsCounter, uint64_t);
+void statsRecordLatency(enum StatsLatency, uint64_t);
+
+#endif
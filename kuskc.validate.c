@@ -0,0 +1,820 @@
+/********************************************************************************
+  Checks every world in a corpus of rooms directories and reports what it found:
+  rooms by number of connections, shortest START to END paths, and how many
+  worlds have each kind of defect. Worlds are checked on every core at once.
+
+  A world is valid if it has exactly one START_ROOM and one END_ROOM, every room
+  has 3 to 6 connections, connections go both ways and never to the room itself
+  or twice to the same room, all rooms are one component, and every room has a
+  path to END. world.bin is checked when there is one, with its stored distances
+  compared against a fresh search, otherwise the text room files are read.
+
+  Build: gcc -o kuskc.validate kuskc.validate.c kuskc.world.c kuskc.stats.c -lpthread
+*********************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "kuskc.world.h"
+
+#define DEGREE_BUCKETS 8	// Rooms with 0 to 6 connections, last bucket is 7 or more
+#define PATH_BUCKETS 33	// Shortest paths of 0 to 31 steps, last bucket is 32 or more
+#define MAX_ROOM_FILE 65536	// Larger text files are not room files
+
+// Ways a world can be broken, each world is counted once per kind it has
+enum Defect
+{
+	DEFECT_UNREADABLE,          // Missing, damaged or unparseable files
+	DEFECT_ROOM_TYPES,          // Not exactly one START_ROOM and one END_ROOM
+	DEFECT_NAMES,               // Shared names, or connections to rooms that do not exist
+	DEFECT_DEGREE,              // Room with fewer than 3 or more than 6 connections
+	DEFECT_SELF_LOOP,
+	DEFECT_DUPLICATE,           // Same room listed twice as a connection
+	DEFECT_ASYMMETRIC,          // A lists B but B does not list A
+	DEFECT_DISCONNECTED,        // More than one component
+	DEFECT_UNREACHABLE,         // Some room has no path to END
+	DEFECT_DISTANCES,           // Distances stored in world.bin are wrong
+	NUM_DEFECTS
+};
+const char *defectNames[NUM_DEFECTS] = {"unreadable", "room_types", "names", "degree", "self_loop",
+	"duplicate", "asymmetric", "disconnected", "unreachable", "distances"};
+
+// One world in the compressed rows of world.bin, whichever format it was read from
+struct Graph
+{
+	uint32_t numRooms;
+	const uint32_t *offsets;
+	const uint32_t *targets;
+	uint32_t numStart, numEnd;
+	uint32_t startRoom, endRoom;
+	const uint32_t *distances;           // Stored distances to check, NULL for text worlds
+	uint32_t unreachableRooms;           // Stored count to check
+};
+
+// Room parsed from a text file. Names are offsets into the thread's text buffer,
+// which moves as it grows.
+struct TextRoom
+{
+	uint32_t name;
+	uint32_t firstConnection;            // Index into connection names
+	uint32_t numConnections;
+	int type;                            // -1 until ROOM TYPE is read
+};
+
+// Room name with its number, sorted so connections can be looked up by name
+struct NamedRoom
+{
+	const char *name;
+	uint32_t room;
+};
+
+// What one thread has found, added to the job totals when it finishes
+struct Totals
+{
+	uint64_t worlds, validWorlds, binaryWorlds, textWorlds;
+	uint64_t rooms, connections;
+	uint64_t defects[NUM_DEFECTS];       // Worlds with each defect
+	uint64_t degrees[DEGREE_BUCKETS];    // Rooms by number of connections
+	uint64_t paths[PATH_BUCKETS];        // Worlds by shortest START to END path
+	uint64_t pathWorlds, totalPath;
+	uint32_t shortestPath, longestPath;
+};
+
+// Buffers of one thread, grown to the largest world seen and reused for the next
+struct Scratch
+{
+	char *text;
+	size_t textSize, textCapacity;
+	struct TextRoom *rooms;
+	uint32_t numRooms, roomCapacity;
+	uint32_t *connectionNames;           // Offsets into text
+	uint32_t numConnections, connectionCapacity;
+	struct NamedRoom *sorted;
+	uint32_t *offsets, *targets;         // Graph built from text rooms
+	uint32_t *parent;                    // Union-find forest
+	uint32_t *distances;                 // Fresh BFS from END
+	uint32_t *queue;
+	uint32_t graphCapacity, targetCapacity;
+};
+
+// Work shared by checking threads
+struct ValidateJob
+{
+	char **directories;
+	int numDirectories;
+	bool preferText;        // Read text room files even when world.bin is there
+	bool quiet;             // Leave out the line for each broken world
+	pthread_mutex_t lock;   // Guards nextDirectory, totals and stdout
+	int nextDirectory;
+	struct Totals totals;
+};
+
+// Function Declarations
+void usage(const char*);
+char **listWorlds(int*);
+bool growArray(void**, uint32_t*, uint32_t, size_t);
+bool reserveGraph(struct Scratch*, uint32_t, uint32_t);
+bool readRoomFile(struct Scratch*, int, const char*);
+bool parseRoomText(struct Scratch*, size_t, size_t);
+int compareNames(const void*, const void*);
+bool loadTextWorld(struct Scratch*, const char*, struct Graph*, bool*);
+uint32_t findRoot(uint32_t*, uint32_t);
+void checkGraph(struct Scratch*, const struct Graph*, bool*, struct Totals*);
+void validateWorld(struct ValidateJob*, struct Scratch*, const char*, struct Totals*);
+void *validateWorker(void*);
+void addTotals(struct Totals*, const struct Totals*);
+void printReport(const struct Totals*);
+
+/***************************************************************************************
+* Main Function
+****************************************************************************************/
+int main(int argc, char *argv[])
+{
+	int numThreads = sysconf(_SC_NPROCESSORS_ONLN);	// Threads checking worlds
+	struct ValidateJob job;
+	memset(&job, 0, sizeof(struct ValidateJob));
+
+	static struct option longOptions[] =
+	{
+		{"threads", required_argument, NULL, 'j'},
+		{"text",    no_argument,       NULL, 't'},
+		{"quiet",   no_argument,       NULL, 'q'},
+		{"help",    no_argument,       NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+
+	int option;
+	while((option = getopt_long(argc, argv, "j:tqh", longOptions, NULL)) != -1)
+	{
+		switch(option)
+		{
+			case 'j':
+				numThreads = atoi(optarg);
+				break;
+			case 't':
+				job.preferText = true;
+				break;
+			case 'q':
+				job.quiet = true;
+				break;
+			default:
+				usage(argv[0]);
+				return option == 'h' ? 0 : 1;
+		}
+	}
+
+	// Worlds named on the command line, or every rooms directory here
+	if(optind < argc)
+	{
+		job.directories = argv + optind;
+		job.numDirectories = argc - optind;
+	}
+	else if((job.directories = listWorlds(&job.numDirectories)) == NULL)
+		return 1;
+	if(job.numDirectories == 0)
+	{
+		fprintf(stderr, "No rooms directories to check\n");
+		return 1;
+	}
+	job.totals.shortestPath = UINT32_MAX;
+	pthread_mutex_init(&job.lock, NULL);
+
+	if(numThreads < 1)
+		numThreads = 1;
+	if(numThreads > job.numDirectories)
+		numThreads = job.numDirectories;
+	pthread_t *threads = malloc(sizeof(pthread_t) * numThreads);
+	int x, started = 0;
+	for(x = 0; threads != NULL && x < numThreads - 1; x++)
+	{
+		if(pthread_create(&threads[started], NULL, validateWorker, &job) == 0)
+			started++;
+	}
+	// Calling thread checks worlds too, so this finishes even if no thread could start
+	validateWorker(&job);
+	for(x = 0; x < started; x++)
+		pthread_join(threads[x], NULL);
+	free(threads);
+	pthread_mutex_destroy(&job.lock);
+
+	printReport(&job.totals);
+	if(optind == argc)
+	{
+		for(x = 0; x < job.numDirectories; x++)
+			free(job.directories[x]);
+		free(job.directories);
+	}
+	return job.totals.validWorlds == job.totals.worlds ? 0 : 1;
+}
+
+/***************************************************************************************
+* Prints command line options
+****************************************************************************************/
+void usage(const char *programName)
+{
+	fprintf(stderr, "Usage: %s [options] [rooms directory...]\n", programName);
+	fprintf(stderr, "  Checks the given worlds, or every kuskc.rooms.* directory here\n");
+	fprintf(stderr, "  -j, --threads T  threads used (default all cores)\n");
+	fprintf(stderr, "  -t, --text       read text room files even where there is a world.bin\n");
+	fprintf(stderr, "  -q, --quiet      only print the report, not each broken world\n");
+	fprintf(stderr, "  -h, --help       show this message\n");
+	fprintf(stderr, "  Exits with 1 if any world has a defect\n");
+}
+
+/***************************************************************************************
+* Returns names of every rooms directory in the current directory and sets count,
+* NULL if the directory could not be read
+****************************************************************************************/
+char **listWorlds(int *count)
+{
+	DIR *dirToCheck = opendir(".");
+	if(dirToCheck == NULL)
+	{
+		perror("opendir");
+		return NULL;
+	}
+
+	uint32_t numWorlds = 0, capacity = 0;
+	char **worlds = NULL;
+	struct dirent *fileInDir;
+	struct stat dirAttributes;
+	while((fileInDir = readdir(dirToCheck)) != NULL)
+	{
+		if(strncmp(fileInDir->d_name, "kuskc.rooms.", 12) != 0)
+			continue;
+		if(stat(fileInDir->d_name, &dirAttributes) < 0 || !S_ISDIR(dirAttributes.st_mode))
+			continue;
+		char *name = NULL;
+		if(!growArray((void**)&worlds, &capacity, numWorlds + 1, sizeof(char*)) ||
+		   (name = strdup(fileInDir->d_name)) == NULL)
+		{
+			perror("malloc");
+			while(numWorlds > 0)
+				free(worlds[--numWorlds]);
+			free(worlds);
+			closedir(dirToCheck);
+			return NULL;
+		}
+		worlds[numWorlds++] = name;
+	}
+	closedir(dirToCheck);
+
+	// Empty list still has to be told apart from a failure
+	*count = numWorlds;
+	return worlds != NULL ? worlds : malloc(sizeof(char*));
+}
+
+/***************************************************************************************
+* Grows array of elements of size so it holds at least needed, doubling each time.
+* False if out of memory, array is left as it was.
+****************************************************************************************/
+bool growArray(void **array, uint32_t *capacity, uint32_t needed, size_t size)
+{
+	if(needed <= *capacity)
+		return true;
+	uint32_t grownCapacity = *capacity ? *capacity : 16;
+	while(grownCapacity < needed)
+		grownCapacity *= 2;
+	void *grown = realloc(*array, (size_t)grownCapacity * size);
+	if(grown == NULL)
+		return false;
+	*array = grown;
+	*capacity = grownCapacity;
+	return true;
+}
+
+/***************************************************************************************
+* Makes room in the search buffers for numRooms rooms and numTargets connections
+****************************************************************************************/
+bool reserveGraph(struct Scratch *scratch, uint32_t numRooms, uint32_t numTargets)
+{
+	if(numRooms + 1 > scratch->graphCapacity)
+	{
+		uint32_t capacity = numRooms + 1;
+		free(scratch->offsets);
+		free(scratch->parent);
+		free(scratch->distances);
+		free(scratch->queue);
+		scratch->offsets = malloc(sizeof(uint32_t) * capacity);
+		scratch->parent = malloc(sizeof(uint32_t) * capacity);
+		scratch->distances = malloc(sizeof(uint32_t) * capacity);
+		scratch->queue = malloc(sizeof(uint32_t) * capacity);
+		scratch->graphCapacity = capacity;
+		if(scratch->offsets == NULL || scratch->parent == NULL || scratch->distances == NULL ||
+		   scratch->queue == NULL)
+		{
+			scratch->graphCapacity = 0;
+			return false;
+		}
+	}
+	return growArray((void**)&scratch->targets, &scratch->targetCapacity, numTargets, sizeof(uint32_t));
+}
+
+/***************************************************************************************
+* Appends the contents of one room file to the text buffer and parses it, false if
+* it could not be read or is not in room file format
+****************************************************************************************/
+bool readRoomFile(struct Scratch *scratch, int dirFd, const char *fileName)
+{
+	int fd = openat(dirFd, fileName, O_RDONLY);
+	struct stat fileAttributes;
+	if(fd < 0 || fstat(fd, &fileAttributes) < 0 || !S_ISREG(fileAttributes.st_mode) ||
+	   fileAttributes.st_size > MAX_ROOM_FILE)
+	{
+		if(fd >= 0)
+			close(fd);
+		return false;
+	}
+
+	// Room for the file and a terminator after it
+	size_t size = fileAttributes.st_size;
+	if(scratch->textSize + size + 1 > scratch->textCapacity)
+	{
+		size_t capacity = scratch->textCapacity ? scratch->textCapacity : 4096;
+		while(capacity < scratch->textSize + size + 1)
+			capacity *= 2;
+		char *grown = realloc(scratch->text, capacity);
+		if(grown == NULL)
+		{
+			close(fd);
+			return false;
+		}
+		scratch->text = grown;
+		scratch->textCapacity = capacity;
+	}
+
+	size_t start = scratch->textSize, done = 0;
+	while(done < size)
+	{
+		ssize_t bytesRead = read(fd, scratch->text + start + done, size - done);
+		if(bytesRead <= 0)
+			break;
+		done += bytesRead;
+	}
+	close(fd);
+	if(done != size)
+		return false;
+	scratch->text[start + size] = '\0';
+	scratch->textSize += size + 1;
+	return parseRoomText(scratch, start, start + size);
+}
+
+/***************************************************************************************
+* Parses rooms in text between start and end, terminating names in place. Unlike
+* adventure this keeps going past bad counts and types so they can be reported.
+****************************************************************************************/
+bool parseRoomText(struct Scratch *scratch, size_t start, size_t end)
+{
+	struct TextRoom *room = NULL;
+	size_t line = start;
+	while(line < end)
+	{
+		char *text = scratch->text + line;
+		char *lineEnd = memchr(text, '\n', end - line);
+		if(lineEnd == NULL)
+			lineEnd = scratch->text + end;
+		*lineEnd = '\0';
+		char *value = strchr(text, ':');
+
+		if(strncmp(text, "ROOM NAME:", 10) == 0)
+		{
+			if(!growArray((void**)&scratch->rooms, &scratch->roomCapacity, scratch->numRooms + 1,
+			              sizeof(struct TextRoom)))
+				return false;
+			room = &scratch->rooms[scratch->numRooms++];
+			room->firstConnection = scratch->numConnections;
+			room->numConnections = 0;
+			room->type = -1;
+		}
+		else if(room == NULL)
+		{
+			// Only blank lines may come before the first room
+			if(strspn(text, " \t\r") != strlen(text))
+				return false;
+			line = lineEnd - scratch->text + 1;
+			continue;
+		}
+		else if(strncmp(text, "CONNECTION ", 11) != 0 && strncmp(text, "ROOM TYPE:", 10) != 0)
+		{
+			if(strspn(text, " \t\r") != strlen(text))
+				return false;
+			line = lineEnd - scratch->text + 1;
+			continue;
+		}
+		if(value == NULL)
+			return false;
+
+		// Value runs from after the colon and its blanks to the end of the line
+		value++;
+		value += strspn(value, " \t");
+		value[strcspn(value, " \t\r")] = '\0';
+		uint32_t offset = value - scratch->text;
+
+		if(text[0] == 'R' && text[5] == 'N')
+			room->name = offset;
+		else if(text[0] == 'C')
+		{
+			if(!growArray((void**)&scratch->connectionNames, &scratch->connectionCapacity,
+			              scratch->numConnections + 1, sizeof(uint32_t)))
+				return false;
+			scratch->connectionNames[scratch->numConnections++] = offset;
+			room->numConnections++;
+		}
+		else if(strcmp(value, "START_ROOM") == 0)
+			room->type = START_ROOM;
+		else if(strcmp(value, "END_ROOM") == 0)
+			room->type = END_ROOM;
+		else if(strcmp(value, "MID_ROOM") == 0)
+			room->type = MID_ROOM;
+		line = lineEnd - scratch->text + 1;
+	}
+	return true;
+}
+
+/***************************************************************************************
+* Orders rooms by name for bsearch
+****************************************************************************************/
+int compareNames(const void *a, const void *b)
+{
+	return strcmp(((const struct NamedRoom*)a)->name, ((const struct NamedRoom*)b)->name);
+}
+
+/***************************************************************************************
+* Reads every text room file of directoryName and builds graph from them. Connections
+* to rooms that do not exist are left out and counted as a names defect in defects.
+* False if the files could not be read at all.
+****************************************************************************************/
+bool loadTextWorld(struct Scratch *scratch, const char *directoryName, struct Graph *graph, bool *defects)
+{
+	scratch->textSize = scratch->numRooms = scratch->numConnections = 0;
+	DIR *dirToRead = opendir(directoryName);
+	if(dirToRead == NULL)
+		return false;
+
+	bool readAll = true;
+	struct dirent *fileInDir;
+	while(readAll && (fileInDir = readdir(dirToRead)) != NULL)
+	{
+		const char *fileName = fileInDir->d_name;
+		if(fileName[0] == '.' || strcmp(fileName, WORLD_FILE_NAME) == 0 ||
+		   strcmp(fileName, WORLD_SOURCE_NAME) == 0)
+			continue;
+		readAll = readRoomFile(scratch, dirfd(dirToRead), fileName);
+	}
+	closedir(dirToRead);
+	if(!readAll || scratch->numRooms == 0)
+		return false;
+
+	// Names are found with a sorted copy, shared names show up next to each other
+	uint32_t numRooms = scratch->numRooms, x, i;
+	uint32_t sortedCapacity = scratch->graphCapacity;
+	if(!reserveGraph(scratch, numRooms, scratch->numConnections))
+		return false;
+	if(scratch->graphCapacity != sortedCapacity || scratch->sorted == NULL)
+	{
+		free(scratch->sorted);
+		scratch->sorted = malloc(sizeof(struct NamedRoom) * scratch->graphCapacity);
+		if(scratch->sorted == NULL)
+			return false;
+	}
+	for(x = 0; x < numRooms; x++)
+	{
+		scratch->sorted[x].name = scratch->text + scratch->rooms[x].name;
+		scratch->sorted[x].room = x;
+	}
+	qsort(scratch->sorted, numRooms, sizeof(struct NamedRoom), compareNames);
+	for(x = 1; x < numRooms; x++)
+	{
+		if(strcmp(scratch->sorted[x - 1].name, scratch->sorted[x].name) == 0)
+			defects[DEFECT_NAMES] = true;
+	}
+
+	memset(graph, 0, sizeof(struct Graph));
+	uint32_t numTargets = 0;
+	for(x = 0; x < numRooms; x++)
+	{
+		const struct TextRoom *room = &scratch->rooms[x];
+		scratch->offsets[x] = numTargets;
+		for(i = 0; i < room->numConnections; i++)
+		{
+			struct NamedRoom key = { scratch->text + scratch->connectionNames[room->firstConnection + i], 0 };
+			struct NamedRoom *found = bsearch(&key, scratch->sorted, numRooms, sizeof(struct NamedRoom), compareNames);
+			if(found == NULL)
+				defects[DEFECT_NAMES] = true;
+			else
+				scratch->targets[numTargets++] = found->room;
+		}
+
+		if(room->type == START_ROOM)
+		{
+			graph->numStart++;
+			graph->startRoom = x;
+		}
+		else if(room->type == END_ROOM)
+		{
+			graph->numEnd++;
+			graph->endRoom = x;
+		}
+		else if(room->type < 0)
+			defects[DEFECT_UNREADABLE] = true;
+	}
+	scratch->offsets[numRooms] = numTargets;
+
+	graph->numRooms = numRooms;
+	graph->offsets = scratch->offsets;
+	graph->targets = scratch->targets;
+	return true;
+}
+
+/***************************************************************************************
+* Returns root of room in the union-find forest, halving the path on the way up
+****************************************************************************************/
+uint32_t findRoot(uint32_t *parent, uint32_t room)
+{
+	while(parent[room] != room)
+	{
+		parent[room] = parent[parent[room]];
+		room = parent[room];
+	}
+	return room;
+}
+
+/***************************************************************************************
+* Runs every graph check on one world, setting the defects it has and adding its
+* degrees and shortest path to totals
+****************************************************************************************/
+void checkGraph(struct Scratch *scratch, const struct Graph *graph, bool *defects, struct Totals *totals)
+{
+	uint32_t numRooms = graph->numRooms, room, i, j;
+	const uint32_t *offsets = graph->offsets, *targets = graph->targets;
+
+	if(graph->numStart != 1 || graph->numEnd != 1 || graph->startRoom == graph->endRoom)
+		defects[DEFECT_ROOM_TYPES] = true;
+
+	for(room = 0; room < numRooms; room++)
+		scratch->parent[room] = room;
+
+	for(room = 0; room < numRooms; room++)
+	{
+		uint32_t degree = offsets[room + 1] - offsets[room];
+		totals->degrees[degree < DEGREE_BUCKETS ? degree : DEGREE_BUCKETS - 1]++;
+		if(degree < 3 || degree > 6)
+			defects[DEFECT_DEGREE] = true;
+
+		for(i = offsets[room]; i < offsets[room + 1]; i++)
+		{
+			uint32_t other = targets[i];
+			if(other == room)
+				defects[DEFECT_SELF_LOOP] = true;
+
+			// Rows are at most 6 long in a valid world, longer ones are already a defect
+			for(j = offsets[room]; j < i && degree <= 64; j++)
+			{
+				if(targets[j] == other)
+					defects[DEFECT_DUPLICATE] = true;
+			}
+			for(j = offsets[other]; j < offsets[other + 1] && targets[j] != room; j++)
+				;
+			if(j == offsets[other + 1])
+				defects[DEFECT_ASYMMETRIC] = true;
+
+			uint32_t a = findRoot(scratch->parent, room), b = findRoot(scratch->parent, other);
+			if(a != b)
+				scratch->parent[a > b ? a : b] = a < b ? a : b;
+		}
+	}
+
+	uint32_t components = 0;
+	for(room = 0; room < numRooms; room++)
+		components += scratch->parent[room] == room;
+	if(components > 1)
+		defects[DEFECT_DISCONNECTED] = true;
+
+	// Without a single END there is nothing to search from
+	if(graph->numEnd != 1)
+		return;
+
+	// Breadth first from END, connections are followed forwards, which is the same as
+	// backwards in a symmetric world
+	uint32_t *distances = scratch->distances, *queue = scratch->queue;
+	uint32_t head = 0, tail = 0, reached = 1;
+	for(room = 0; room < numRooms; room++)
+		distances[room] = WORLD_UNREACHABLE;
+	distances[graph->endRoom] = 0;
+	queue[tail++] = graph->endRoom;
+	while(head < tail)
+	{
+		room = queue[head++];
+		for(i = offsets[room]; i < offsets[room + 1]; i++)
+		{
+			if(distances[targets[i]] == WORLD_UNREACHABLE)
+			{
+				distances[targets[i]] = distances[room] + 1;
+				queue[tail++] = targets[i];
+				reached++;
+			}
+		}
+	}
+	if(reached < numRooms)
+		defects[DEFECT_UNREACHABLE] = true;
+	if(graph->distances != NULL &&
+	   (memcmp(graph->distances, distances, sizeof(uint32_t) * numRooms) != 0 ||
+	    graph->unreachableRooms != numRooms - reached))
+		defects[DEFECT_DISTANCES] = true;
+
+	if(graph->numStart == 1 && distances[graph->startRoom] != WORLD_UNREACHABLE)
+	{
+		uint32_t path = distances[graph->startRoom];
+		totals->paths[path < PATH_BUCKETS ? path : PATH_BUCKETS - 1]++;
+		totals->pathWorlds++;
+		totals->totalPath += path;
+		if(path < totals->shortestPath)
+			totals->shortestPath = path;
+		if(path > totals->longestPath)
+			totals->longestPath = path;
+	}
+}
+
+/***************************************************************************************
+* Checks the world in directoryName and adds what was found to totals
+****************************************************************************************/
+void validateWorld(struct ValidateJob *job, struct Scratch *scratch, const char *directoryName,
+                   struct Totals *totals)
+{
+	bool defects[NUM_DEFECTS] = { false };
+	struct Graph graph;
+	struct World world;
+	bool binary = false, loaded;
+
+	char fileName[300];
+	snprintf(fileName, sizeof(fileName), "%s/%s", directoryName, WORLD_FILE_NAME);
+	if(!job->preferText && access(fileName, F_OK) == 0)
+	{
+		// Bounds are checked before anything is followed, so a damaged file is only unreadable
+		binary = true;
+		loaded = worldOpen(&world, fileName) && worldCheck(&world) &&
+		         reserveGraph(scratch, world.header->numRooms, 0);
+		if(loaded)
+		{
+			graph.numRooms = world.header->numRooms;
+			graph.offsets = world.offsets;
+			graph.targets = world.targets;
+			graph.numStart = graph.numEnd = 1;
+			graph.startRoom = world.header->startRoom;
+			graph.endRoom = world.header->endRoom;
+			graph.distances = world.distances;
+			graph.unreachableRooms = world.header->unreachableRooms;
+		}
+	}
+	else
+		loaded = loadTextWorld(scratch, directoryName, &graph, defects);
+
+	if(loaded)
+	{
+		totals->rooms += graph.numRooms;
+		totals->connections += graph.offsets[graph.numRooms];
+		checkGraph(scratch, &graph, defects, totals);
+	}
+	else
+		defects[DEFECT_UNREADABLE] = true;
+	if(binary)
+		worldClose(&world);
+
+	totals->worlds++;
+	totals->binaryWorlds += binary;
+	totals->textWorlds += !binary;
+	char line[512];
+	int length = snprintf(line, sizeof(line), "%s:", directoryName);
+	bool valid = true;
+	int x;
+	for(x = 0; x < NUM_DEFECTS; x++)
+	{
+		if(!defects[x])
+			continue;
+		totals->defects[x]++;
+		if(length < (int)sizeof(line))
+			length += snprintf(line + length, sizeof(line) - length, "%s %s", valid ? "" : ",", defectNames[x]);
+		valid = false;
+	}
+	totals->validWorlds += valid;
+
+	// Whole line in one call so lines from different threads never mix
+	if(!valid && !job->quiet)
+	{
+		pthread_mutex_lock(&job->lock);
+		printf("%s\n", line);
+		pthread_mutex_unlock(&job->lock);
+	}
+}
+
+/***************************************************************************************
+* Checking thread, takes worlds until none are left, then adds its totals to the job
+****************************************************************************************/
+void *validateWorker(void *arguments)
+{
+	struct ValidateJob *job = arguments;
+	struct Scratch scratch;
+	struct Totals totals;
+	memset(&scratch, 0, sizeof(struct Scratch));
+	memset(&totals, 0, sizeof(struct Totals));
+	totals.shortestPath = UINT32_MAX;
+
+	for(;;)
+	{
+		pthread_mutex_lock(&job->lock);
+		int directory = job->nextDirectory++;
+		pthread_mutex_unlock(&job->lock);
+		if(directory >= job->numDirectories)
+			break;
+		validateWorld(job, &scratch, job->directories[directory], &totals);
+	}
+
+	pthread_mutex_lock(&job->lock);
+	addTotals(&job->totals, &totals);
+	pthread_mutex_unlock(&job->lock);
+
+	free(scratch.text);
+	free(scratch.rooms);
+	free(scratch.connectionNames);
+	free(scratch.sorted);
+	free(scratch.offsets);
+	free(scratch.targets);
+	free(scratch.parent);
+	free(scratch.distances);
+	free(scratch.queue);
+	return NULL;
+}
+
+/***************************************************************************************
+* Adds one thread's totals into total
+****************************************************************************************/
+void addTotals(struct Totals *total, const struct Totals *part)
+{
+	int x;
+	total->worlds += part->worlds;
+	total->validWorlds += part->validWorlds;
+	total->binaryWorlds += part->binaryWorlds;
+	total->textWorlds += part->textWorlds;
+	total->rooms += part->rooms;
+	total->connections += part->connections;
+	for(x = 0; x < NUM_DEFECTS; x++)
+		total->defects[x] += part->defects[x];
+	for(x = 0; x < DEGREE_BUCKETS; x++)
+		total->degrees[x] += part->degrees[x];
+	for(x = 0; x < PATH_BUCKETS; x++)
+		total->paths[x] += part->paths[x];
+	total->pathWorlds += part->pathWorlds;
+	total->totalPath += part->totalPath;
+	if(part->shortestPath < total->shortestPath)
+		total->shortestPath = part->shortestPath;
+	if(part->longestPath > total->longestPath)
+		total->longestPath = part->longestPath;
+}
+
+/***************************************************************************************
+* Prints everything found, only buckets with something in them
+****************************************************************************************/
+void printReport(const struct Totals *totals)
+{
+	int x;
+	printf("Worlds: %" PRIu64 " (%" PRIu64 " binary, %" PRIu64 " text), %" PRIu64 " valid, %" PRIu64
+	       " with defects\n", totals->worlds, totals->binaryWorlds, totals->textWorlds,
+	       totals->validWorlds, totals->worlds - totals->validWorlds);
+	printf("Rooms: %" PRIu64 ", connections: %" PRIu64 "\n", totals->rooms, totals->connections / 2);
+
+	printf("Defects (worlds):\n");
+	for(x = 0; x < NUM_DEFECTS; x++)
+		printf("  %-13s %" PRIu64 "\n", defectNames[x], totals->defects[x]);
+
+	printf("Rooms by connections:\n");
+	for(x = 0; x < DEGREE_BUCKETS; x++)
+	{
+		if(totals->degrees[x] > 0)
+			printf("  %d%s %14" PRIu64 " %6.2f%%\n", x, x == DEGREE_BUCKETS - 1 ? "+" : " ",
+			       totals->degrees[x], 100.0 * totals->degrees[x] / totals->rooms);
+	}
+
+	printf("Shortest path START to END (worlds):\n");
+	if(totals->pathWorlds == 0)
+	{
+		printf("  none reach END\n");
+		return;
+	}
+	printf("  min %u, mean %.2f, max %u\n", totals->shortestPath,
+	       (double)totals->totalPath / totals->pathWorlds, totals->longestPath);
+	for(x = 0; x < PATH_BUCKETS; x++)
+	{
+		if(totals->paths[x] > 0)
+			printf("  %2d%s %13" PRIu64 " %6.2f%%\n", x, x == PATH_BUCKETS - 1 ? "+" : " ",
+			       totals->paths[x], 100.0 * totals->paths[x] / totals->pathWorlds);
+	}
+}
@@ -0,0 +1,1683 @@
+/********************************************************************************
+  Creates, saves and maps binary world files and world archives, see kuskc.world.h
+  for the layouts
+*********************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>	// Needed for flock
+#include <inttypes.h>
+#include <pthread.h>
+#include <time.h>
+#include "kuskc.world.h"
+#include "kuskc.stats.h"
+
+// Function Declarations
+static uint64_t alignSection(uint64_t);
+static bool checkHeader(const struct WorldHeader*, uint64_t);
+static bool attachSections(struct World*);
+static uint32_t hashName(const char*);
+static bool readManifest(char*, size_t, uint64_t*);
+static void *bfsRange(void*);
+static uint32_t bfsDistances(const struct World*, uint32_t, uint32_t*, uint64_t*, uint64_t*, int, uint32_t*);
+static uint32_t eccentricity(const struct World*, uint32_t, uint32_t*, uint32_t*, uint32_t*);
+static void writeSourceArray(FILE*, const char*, const uint32_t*, uint32_t);
+static bool readSection(int, void*, size_t, uint64_t);
+static bool readCachedRoom(const struct WorldCache*, uint32_t, struct CachedRoom*);
+static uint32_t cacheHash(const struct WorldCache*, uint32_t);
+static void cacheRemove(struct WorldCache*, uint32_t);
+static char foldLetter(char);
+static int compareFolded(const void*, const void*);
+static size_t putVarint(uint8_t*, uint64_t);
+static bool getVarint(const uint8_t**, const uint8_t*, uint64_t*);
+static size_t splitName(const char*, uint32_t*);
+static int archiveStem(struct ArchiveHeader*, const char*, size_t);
+static bool checkArchiveHeader(const struct ArchiveHeader*, const char*);
+static bool writeSection(int, const void*, size_t, uint64_t);
+static bool decodeArchiveRecord(const struct ArchiveHeader*, const uint8_t*, uint64_t, struct World*);
+
+#define BFS_PARALLEL_ROOMS 65536	// Smaller worlds are searched on one thread
+#define EXACT_DIAMETER_ROOMS 1024	// Larger worlds get a two sweep lower bound
+
+// One thread's share of a BFS level, whole 64 room words so threads never share a word
+struct BfsRange
+{
+	const struct World *world;
+	uint32_t *distances;
+	const uint64_t *frontier;    // Rooms found on the previous level
+	uint64_t *next;              // Rooms found on this level
+	uint32_t level;
+	uint32_t firstWord, lastWord;
+	uint32_t found;              // Rooms found by this range
+	uint32_t lastFound;          // Any room found by this range
+};
+
+// Room name sorted when a WorldMatcher is built
+struct FoldedName
+{
+	const char *name;
+	uint32_t room;
+};
+
+/***************************************************************************************
+* Rounds offset up to next multiple of 8
+****************************************************************************************/
+static uint64_t alignSection(uint64_t offset)
+{
+	return (offset + 7) & ~(uint64_t)7;
+}
+
+/***************************************************************************************
+* FNV-1a hash of a room name
+****************************************************************************************/
+static uint32_t hashName(const char *name)
+{
+	uint32_t hash = 2166136261u;
+	while(*name != '\0')
+	{
+		hash ^= (unsigned char)*name++;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+/***************************************************************************************
+* Checks that header belongs to a world file of size bytes and that every section
+* fits inside it
+****************************************************************************************/
+static bool checkHeader(const struct WorldHeader *header, uint64_t size)
+{
+	if(size < sizeof(struct WorldHeader) ||
+	   memcmp(header->magic, WORLD_MAGIC, 8) != 0)
+	{
+		fprintf(stderr, "Not a world file\n");
+		return false;
+	}
+	if(header->version != WORLD_VERSION)
+	{
+		fprintf(stderr, "World file version %u, expected %u\n", header->version, WORLD_VERSION);
+		return false;
+	}
+
+	// Every section has to fit inside the image
+	if(header->fileSize != size ||
+	   header->offsetsOffset + ((uint64_t)header->numRooms + 1) * sizeof(uint32_t) > size ||
+	   header->targetsOffset + (uint64_t)header->numConnections * sizeof(uint32_t) > size ||
+	   header->namesOffset + (uint64_t)header->numRooms * sizeof(uint32_t) > size ||
+	   header->indexOffset + (uint64_t)header->indexSize * sizeof(uint32_t) > size ||
+	   header->indexSize < header->numRooms || (header->indexSize & (header->indexSize - 1)) != 0 ||
+	   header->distancesOffset + (uint64_t)header->numRooms * sizeof(uint32_t) > size ||
+	   header->stringPoolOffset + header->stringPoolSize > size ||
+	   header->stringPoolSize == 0 ||
+	   header->startRoom >= header->numRooms || header->endRoom >= header->numRooms)
+	{
+		fprintf(stderr, "World file is truncated or corrupt\n");
+		return false;
+	}
+	return true;
+}
+
+/***************************************************************************************
+* Checks header of image at world->base and points the section pointers into it.
+* Only the header is checked so this takes the same time for any number of rooms.
+****************************************************************************************/
+static bool attachSections(struct World *world)
+{
+	const struct WorldHeader *header = world->base;
+	if(!checkHeader(header, world->size))
+		return false;
+
+	world->header = header;
+	world->offsets = (const uint32_t*)((const char*)world->base + header->offsetsOffset);
+	world->targets = (const uint32_t*)((const char*)world->base + header->targetsOffset);
+	world->names = (const uint32_t*)((const char*)world->base + header->namesOffset);
+	world->index = (const uint32_t*)((const char*)world->base + header->indexOffset);
+	world->distances = (const uint32_t*)((const char*)world->base + header->distancesOffset);
+	world->strings = (const char*)world->base + header->stringPoolOffset;
+
+	// Offsets have to end at the last target so connection reads stay in bounds
+	if(world->offsets[header->numRooms] != header->numConnections)
+	{
+		fprintf(stderr, "World file connection offsets are corrupt\n");
+		return false;
+	}
+
+	// Last name has to be terminated so reads never run off the pool
+	if(world->strings[header->stringPoolSize - 1] != '\0')
+	{
+		fprintf(stderr, "World file string pool is not terminated\n");
+		return false;
+	}
+	return true;
+}
+
+/***************************************************************************************
+* Allocates a zeroed world image with header filled in. Caller fills the offsets,
+* targets, names and string pool through the section pointers, then calls
+* worldBuildIndex and worldComputeDistances, and worldComputeDiameter if wanted.
+****************************************************************************************/
+bool worldCreate(struct World *world, uint32_t numRooms, uint32_t numConnections, uint32_t stringPoolSize)
+{
+	// Keep name index at most half full so probes stay short
+	uint32_t indexSize = 1;
+	while(indexSize < 2 * (uint64_t)numRooms)
+		indexSize *= 2;
+
+	// Lay out sections one after the other
+	uint64_t offsetsOffset = alignSection(sizeof(struct WorldHeader));
+	uint64_t targetsOffset = alignSection(offsetsOffset + ((uint64_t)numRooms + 1) * sizeof(uint32_t));
+	uint64_t namesOffset = alignSection(targetsOffset + (uint64_t)numConnections * sizeof(uint32_t));
+	uint64_t indexOffset = alignSection(namesOffset + (uint64_t)numRooms * sizeof(uint32_t));
+	uint64_t distancesOffset = alignSection(indexOffset + (uint64_t)indexSize * sizeof(uint32_t));
+	uint64_t stringPoolOffset = alignSection(distancesOffset + (uint64_t)numRooms * sizeof(uint32_t));
+	uint64_t fileSize = alignSection(stringPoolOffset + stringPoolSize);
+
+	memset(world, 0, sizeof(struct World));
+	world->base = calloc(1, fileSize);
+	if(world->base == NULL)
+	{
+		perror("calloc");
+		return false;
+	}
+	world->size = fileSize;
+	world->mapped = false;
+
+	struct WorldHeader *header = world->base;
+	memcpy(header->magic, WORLD_MAGIC, 8);
+	header->version = WORLD_VERSION;
+	header->numRooms = numRooms;
+	header->numConnections = numConnections;
+	header->stringPoolSize = stringPoolSize;
+	header->offsetsOffset = offsetsOffset;
+	header->targetsOffset = targetsOffset;
+	header->namesOffset = namesOffset;
+	header->indexOffset = indexOffset;
+	header->indexSize = indexSize;
+	header->distancesOffset = distancesOffset;
+	header->stringPoolOffset = stringPoolOffset;
+	header->fileSize = fileSize;
+
+	world->header = header;
+	world->offsets = (const uint32_t*)((char*)world->base + offsetsOffset);
+	world->targets = (const uint32_t*)((char*)world->base + targetsOffset);
+	world->names = (const uint32_t*)((char*)world->base + namesOffset);
+	world->index = (const uint32_t*)((char*)world->base + indexOffset);
+	world->distances = (const uint32_t*)((char*)world->base + distancesOffset);
+	world->strings = (const char*)world->base + stringPoolOffset;
+	return true;
+}
+
+/***************************************************************************************
+* Maps world file read only, nothing is read until rooms are touched
+****************************************************************************************/
+bool worldOpen(struct World *world, const char *fileName)
+{
+	uint64_t start = STATS_NOW();
+	memset(world, 0, sizeof(struct World));
+
+	int fd = open(fileName, O_RDONLY);
+	if(fd < 0)
+	{
+		perror(fileName);
+		return false;
+	}
+
+	struct stat fileAttributes;
+	if(fstat(fd, &fileAttributes) < 0)
+	{
+		perror(fileName);
+		close(fd);
+		return false;
+	}
+
+	world->size = fileAttributes.st_size;
+	world->base = mmap(NULL, world->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// Mapping stays valid after the descriptor is closed
+	close(fd);
+	if(world->base == MAP_FAILED)
+	{
+		perror("mmap");
+		world->base = NULL;
+		return false;
+	}
+	world->mapped = true;
+
+	if(!attachSections(world))
+	{
+		worldClose(world);
+		return false;
+	}
+	STATS_TIMER(TIMER_OPEN_WORLD, start);
+	return true;
+}
+
+/***************************************************************************************
+* Checks every room number and name offset in the world so a damaged file can not
+* cause reads outside the image. Takes O(rooms + connections), so it is only run
+* when asked for.
+****************************************************************************************/
+bool worldCheck(const struct World *world)
+{
+	const struct WorldHeader *header = world->header;
+	uint32_t room, i;
+
+	if(world->offsets[0] != 0)
+	{
+		fprintf(stderr, "World file connections do not start at 0\n");
+		return false;
+	}
+	for(room = 0; room < header->numRooms; room++)
+	{
+		if(world->offsets[room + 1] < world->offsets[room])
+		{
+			fprintf(stderr, "World file offsets go backwards at room %u\n", room);
+			return false;
+		}
+		if(world->names[room] >= header->stringPoolSize)
+		{
+			fprintf(stderr, "World file name of room %u is outside the string pool\n", room);
+			return false;
+		}
+	}
+	for(i = 0; i < header->numConnections; i++)
+	{
+		if(world->targets[i] >= header->numRooms)
+		{
+			fprintf(stderr, "World file connection %u names room %u of %u\n", i, world->targets[i], header->numRooms);
+			return false;
+		}
+	}
+	for(i = 0; i < header->indexSize; i++)
+	{
+		if(world->index[i] != WORLD_NO_ROOM && world->index[i] >= header->numRooms)
+		{
+			fprintf(stderr, "World file name index slot %u names room %u of %u\n", i, world->index[i], header->numRooms);
+			return false;
+		}
+	}
+
+	// Every room must be found by its own name, which also rules out shared names
+	for(room = 0; room < header->numRooms; room++)
+	{
+		if(worldFindRoom(world, worldRoomName(world, room)) != room)
+		{
+			fprintf(stderr, "World file room %u (%s) is not found by its name\n", room, worldRoomName(world, room));
+			return false;
+		}
+	}
+	return true;
+}
+
+/***************************************************************************************
+* Writes whole world image to file, and flushes it to disk first if sync is set
+****************************************************************************************/
+bool worldSave(const struct World *world, const char *fileName, bool sync)
+{
+	int fd = open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0)
+	{
+		perror(fileName);
+		return false;
+	}
+
+	// write may stop early on large images, keep going until everything is out
+	const char *next = world->base;
+	size_t remaining = world->size;
+	while(remaining > 0)
+	{
+		ssize_t written = write(fd, next, remaining);
+		if(written < 0)
+		{
+			perror(fileName);
+			close(fd);
+			return false;
+		}
+		next += written;
+		remaining -= written;
+	}
+
+	if((sync && fsync(fd) < 0) | (close(fd) < 0))
+	{
+		perror(fileName);
+		return false;
+	}
+	STATS_COUNT(COUNTER_FILES_WRITTEN, 1);
+	STATS_COUNT(COUNTER_BYTES_WRITTEN, world->size);
+	return true;
+}
+
+/***************************************************************************************
+* Writes count numbers of a section as a static const array called name
+****************************************************************************************/
+static void writeSourceArray(FILE *source, const char *name, const uint32_t *values, uint32_t count)
+{
+	fprintf(source, "\nstatic const uint32_t %s[%u] =\n{", name, count ? count : 1);
+	uint32_t i;
+	for(i = 0; i < count; i++)
+	{
+		fputs(i % 16 ? " " : "\n\t", source);
+		// Empty index slots and unreachable rooms
+		if(values[i] == UINT32_MAX)
+			fputs("0xFFFFFFFF,", source);
+		else
+			fprintf(source, "%u,", values[i]);
+	}
+	fprintf(source, "%s\n};\n", count ? "" : "\n\t0");
+}
+
+/***************************************************************************************
+* Writes world as a C header of static const sections and a struct World pointing at
+* them, called embeddedWorld. A program that includes it plays the world without
+* reading any file. Sections are the same as in the world file, so every world
+* function works on it except worldSave and worldClose.
+****************************************************************************************/
+bool worldSaveSource(const struct World *world, const char *fileName, bool sync)
+{
+	const struct WorldHeader *header = world->header;
+	FILE *source = fopen(fileName, "w");
+	if(source == NULL)
+	{
+		perror(fileName);
+		return false;
+	}
+
+	fprintf(source, "/* Generated by buildrooms -f source, do not edit. %u rooms, START_ROOM %s,\n"
+	        "   END_ROOM %s, every other room is a MID_ROOM. */\n\n",
+	        header->numRooms, worldRoomName(world, header->startRoom), worldRoomName(world, header->endRoom));
+	fprintf(source, "#ifndef KUSKC_EMBEDDED_WORLD_H\n#define KUSKC_EMBEDDED_WORLD_H\n\n"
+	        "#include \"kuskc.world.h\"\n");
+
+	// Offsets into the file are kept, they tell where the world came from and are not used
+	fprintf(source, "\nstatic const struct WorldHeader embeddedHeader =\n{\n"
+	        "\t.magic = WORLD_MAGIC, .version = %u,\n"
+	        "\t.numRooms = %u, .numConnections = %u, .startRoom = %u, .endRoom = %u,\n"
+	        "\t.stringPoolSize = %u, .indexSize = %u, .unreachableRooms = %u,\n"
+	        "\t.diameter = %u, .diameterExact = %u,\n"
+	        "\t.offsetsOffset = %" PRIu64 ", .targetsOffset = %" PRIu64 ", .namesOffset = %" PRIu64 ",\n"
+	        "\t.indexOffset = %" PRIu64 ", .distancesOffset = %" PRIu64 ", .stringPoolOffset = %" PRIu64 ",\n"
+	        "\t.fileSize = %" PRIu64 "\n};\n",
+	        header->version, header->numRooms, header->numConnections, header->startRoom, header->endRoom,
+	        header->stringPoolSize, header->indexSize, header->unreachableRooms, header->diameter,
+	        header->diameterExact, header->offsetsOffset, header->targetsOffset, header->namesOffset,
+	        header->indexOffset, header->distancesOffset, header->stringPoolOffset, header->fileSize);
+
+	writeSourceArray(source, "embeddedOffsets", world->offsets, header->numRooms + 1);
+	writeSourceArray(source, "embeddedTargets", world->targets, header->numConnections);
+	writeSourceArray(source, "embeddedNames", world->names, header->numRooms);
+	writeSourceArray(source, "embeddedIndex", world->index, header->indexSize);
+	writeSourceArray(source, "embeddedDistances", world->distances, header->numRooms);
+
+	// One literal per name, anything but letters and digits as three digit octal so an
+	// escape never swallows the character after it
+	fprintf(source, "\nstatic const char embeddedStrings[%u] =\n", header->stringPoolSize);
+	uint32_t offset = 0;
+	while(offset < header->stringPoolSize)
+	{
+		const char *name = world->strings + offset;
+		fputs("\t\"", source);
+		for(; *name != '\0'; name++)
+		{
+			if(isalnum((unsigned char)*name))
+				fputc(*name, source);
+			else
+				fprintf(source, "\\%03o", (unsigned char)*name);
+		}
+		fputs("\\0\"\n", source);
+		offset = name - world->strings + 1;
+	}
+	fprintf(source, "\t;\n");
+
+	fprintf(source, "\nstatic const struct World embeddedWorld =\n{\n"
+	        "\t.header = &embeddedHeader, .offsets = embeddedOffsets, .targets = embeddedTargets,\n"
+	        "\t.names = embeddedNames, .index = embeddedIndex, .distances = embeddedDistances,\n"
+	        "\t.strings = embeddedStrings\n};\n\n#endif\n");
+
+	bool saved = !ferror(source) && fflush(source) == 0;
+	long length = ftell(source);
+	if(saved && sync)
+		saved = fsync(fileno(source)) == 0;
+	if(fclose(source) != 0)
+		saved = false;
+	if(!saved)
+	{
+		perror(fileName);
+		return false;
+	}
+	STATS_COUNT(COUNTER_FILES_WRITTEN, 1);
+	STATS_COUNT(COUNTER_BYTES_WRITTEN, length);
+	return true;
+}
+
+/***************************************************************************************
+* Unmaps or frees world image
+****************************************************************************************/
+void worldClose(struct World *world)
+{
+	if(world->base != NULL)
+	{
+		if(world->mapped)
+			munmap(world->base, world->size);
+		else
+			free(world->base);
+	}
+	memset(world, 0, sizeof(struct World));
+}
+
+/***************************************************************************************
+* Returns type as written in the text room files
+****************************************************************************************/
+const char *roomTypeName(enum RoomType type)
+{
+	switch(type)
+	{
+		case START_ROOM:
+			return "START_ROOM";
+		case END_ROOM:
+			return "END_ROOM";
+		default:
+			return "MID_ROOM";
+	}
+}
+
+/***************************************************************************************
+* Fills name index of a world built with worldCreate, names must already be set.
+* False if two rooms share a name, since moves could never reach the second one.
+****************************************************************************************/
+bool worldBuildIndex(struct World *world)
+{
+	uint32_t *index = (uint32_t*)world->index;
+	uint32_t mask = world->header->indexSize - 1;
+	memset(index, 0xFF, (size_t)world->header->indexSize * sizeof(uint32_t));
+
+	uint32_t room;
+	for(room = 0; room < world->header->numRooms; room++)
+	{
+		// Linear probing, table is at most half full so a free slot is always near
+		const char *name = worldRoomName(world, room);
+		uint32_t slot = hashName(name) & mask;
+		while(index[slot] != WORLD_NO_ROOM)
+		{
+			if(strcmp(worldRoomName(world, index[slot]), name) == 0)
+			{
+				fprintf(stderr, "Room name %s is used by more than one room\n", name);
+				return false;
+			}
+			slot = (slot + 1) & mask;
+		}
+		index[slot] = room;
+	}
+	return true;
+}
+
+/***************************************************************************************
+* Returns room number with given name, or WORLD_NO_ROOM if there is none
+****************************************************************************************/
+uint32_t worldFindRoom(const struct World *world, const char *name)
+{
+	uint32_t mask = world->header->indexSize - 1;
+	uint32_t slot = hashName(name) & mask;
+	uint32_t probes;
+
+	// Probe count is bounded so a damaged index can not loop forever
+	for(probes = 0; probes <= mask && world->index[slot] != WORLD_NO_ROOM; probes++)
+	{
+		uint32_t room = world->index[slot];
+		if(room < world->header->numRooms && strcmp(worldRoomName(world, room), name) == 0)
+			return room;
+		slot = (slot + 1) & mask;
+	}
+	return WORLD_NO_ROOM;
+}
+
+/***************************************************************************************
+* Finds every unvisited room in a range of words that has a connection in the frontier
+****************************************************************************************/
+static void *bfsRange(void *arguments)
+{
+	struct BfsRange *range = arguments;
+	const struct World *world = range->world;
+	uint32_t numRooms = world->header->numRooms;
+	uint32_t word;
+
+	range->found = 0;
+	for(word = range->firstWord; word < range->lastWord; word++)
+	{
+		uint64_t bits = 0;
+		uint32_t room = word * 64;
+		uint32_t lastRoom = room + 64 < numRooms ? room + 64 : numRooms;
+		for(; room < lastRoom; room++)
+		{
+			if(range->distances[room] != WORLD_UNREACHABLE)
+				continue;
+
+			// Bottom up, a room only needs one connection in the frontier
+			uint32_t i;
+			for(i = world->offsets[room]; i < world->offsets[room + 1]; i++)
+			{
+				uint32_t other = world->targets[i];
+				if(range->frontier[other / 64] & (1ull << (other % 64)))
+				{
+					range->distances[room] = range->level;
+					bits |= 1ull << (room % 64);
+					range->found++;
+					range->lastFound = room;
+					break;
+				}
+			}
+		}
+		range->next[word] = bits;
+	}
+	return NULL;
+}
+
+/***************************************************************************************
+* Level by level BFS from source using frontier bitsets. Each level every thread scans
+* its own rooms, so threads write disjoint parts of distances and next. frontier and
+* next are scratch bitsets of (numRooms + 63) / 64 words. Returns the largest distance
+* and sets farthest to a room that far away.
+****************************************************************************************/
+static uint32_t bfsDistances(const struct World *world, uint32_t source, uint32_t *distances,
+                             uint64_t *frontier, uint64_t *next, int numThreads, uint32_t *farthest)
+{
+	uint32_t numRooms = world->header->numRooms;
+	uint32_t numWords = (numRooms + 63) / 64;
+	if(numRooms < BFS_PARALLEL_ROOMS || numThreads < 1)
+		numThreads = 1;
+	if(numThreads > 64)
+		numThreads = 64;
+
+	memset(distances, 0xFF, (size_t)numRooms * sizeof(uint32_t));
+	memset(frontier, 0, (size_t)numWords * sizeof(uint64_t));
+	distances[source] = 0;
+	frontier[source / 64] = 1ull << (source % 64);
+	*farthest = source;
+
+	struct BfsRange ranges[64];
+	pthread_t threads[64];
+	uint32_t level;
+	for(level = 1; ; level++)
+	{
+		int x;
+		uint32_t found = 0;
+		for(x = 0; x < numThreads; x++)
+		{
+			ranges[x].world = world;
+			ranges[x].distances = distances;
+			ranges[x].frontier = frontier;
+			ranges[x].next = next;
+			ranges[x].level = level;
+			ranges[x].firstWord = (uint64_t)numWords * x / numThreads;
+			ranges[x].lastWord = (uint64_t)numWords * (x + 1) / numThreads;
+		}
+
+		// Calling thread takes the first range, and any range a thread failed to take
+		bool started[64] = { false };
+		for(x = 1; x < numThreads; x++)
+			started[x] = pthread_create(&threads[x], NULL, bfsRange, &ranges[x]) == 0;
+		for(x = 0; x < numThreads; x++)
+		{
+			if(x == 0 || !started[x])
+				bfsRange(&ranges[x]);
+		}
+		for(x = 1; x < numThreads; x++)
+		{
+			if(started[x])
+				pthread_join(threads[x], NULL);
+		}
+
+		for(x = 0; x < numThreads; x++)
+		{
+			found += ranges[x].found;
+			if(ranges[x].found > 0)
+				*farthest = ranges[x].lastFound;
+		}
+		if(found == 0)
+			return level - 1;
+
+		uint64_t *swap = frontier;
+		frontier = next;
+		next = swap;
+	}
+}
+
+/***************************************************************************************
+* Fills distances to END of a world built with worldCreate and counts the rooms that
+* can not reach it. This is all a game needs.
+****************************************************************************************/
+void worldComputeDistances(struct World *world, int numThreads)
+{
+	struct WorldHeader *header = world->base;
+	uint32_t *distances = (uint32_t*)world->distances;
+	uint32_t numRooms = header->numRooms;
+	uint32_t numWords = (numRooms + 63) / 64;
+	uint32_t farthest, room;
+
+	uint64_t *frontier = malloc(sizeof(uint64_t) * numWords);
+	uint64_t *next = malloc(sizeof(uint64_t) * numWords);
+	if(frontier == NULL || next == NULL)
+	{
+		// Without memory every room just reads as unreachable
+		perror("malloc");
+		memset(distances, 0xFF, (size_t)numRooms * sizeof(uint32_t));
+		header->unreachableRooms = numRooms;
+		free(frontier);
+		free(next);
+		return;
+	}
+
+	uint64_t start = STATS_NOW();
+	bfsDistances(world, header->endRoom, distances, frontier, next, numThreads, &farthest);
+	STATS_TIMER(TIMER_DISTANCES, start);
+	header->unreachableRooms = 0;
+	for(room = 0; room < numRooms; room++)
+		header->unreachableRooms += distances[room] == WORLD_UNREACHABLE;
+
+	free(frontier);
+	free(next);
+}
+
+/***************************************************************************************
+* Plain queue BFS from source, returns the largest distance found and sets farthest
+* to a room that far away. distances and queue hold numRooms entries.
+****************************************************************************************/
+static uint32_t eccentricity(const struct World *world, uint32_t source, uint32_t *distances,
+                             uint32_t *queue, uint32_t *farthest)
+{
+	memset(distances, 0xFF, (size_t)world->header->numRooms * sizeof(uint32_t));
+	distances[source] = 0;
+	queue[0] = source;
+
+	uint32_t head = 0, tail = 1;
+	while(head < tail)
+	{
+		uint32_t room = queue[head++];
+		uint32_t i;
+		for(i = world->offsets[room]; i < world->offsets[room + 1]; i++)
+		{
+			uint32_t other = world->targets[i];
+			if(distances[other] == WORLD_UNREACHABLE)
+			{
+				distances[other] = distances[room] + 1;
+				queue[tail++] = other;
+			}
+		}
+	}
+
+	// Queue is in order of distance, so the last room is the farthest
+	*farthest = queue[tail - 1];
+	return distances[*farthest];
+}
+
+/***************************************************************************************
+* Sets diameter of a world whose distances are already computed. Small worlds search
+* from every room, larger ones use the two sweep lower bound starting from the room
+* farthest from END. Only buildrooms needs this.
+****************************************************************************************/
+void worldComputeDiameter(struct World *world)
+{
+	struct WorldHeader *header = world->base;
+	uint32_t numRooms = header->numRooms;
+	uint32_t farthest = header->endRoom, room;
+	uint32_t diameter = 0;
+
+	uint32_t *scratch = malloc(sizeof(uint32_t) * numRooms);
+	uint32_t *queue = malloc(sizeof(uint32_t) * numRooms);
+	if(scratch == NULL || queue == NULL)
+	{
+		perror("malloc");
+		header->diameter = 0;
+		header->diameterExact = 0;
+		free(scratch);
+		free(queue);
+		return;
+	}
+
+	uint64_t start = STATS_NOW();
+	if(numRooms <= EXACT_DIAMETER_ROOMS)
+	{
+		for(room = 0; room < numRooms; room++)
+		{
+			uint32_t distance = eccentricity(world, room, scratch, queue, &farthest);
+			if(distance > diameter)
+				diameter = distance;
+		}
+		header->diameterExact = 1;
+	}
+	else
+	{
+		for(room = 0; room < numRooms; room++)
+		{
+			if(world->distances[room] != WORLD_UNREACHABLE &&
+			   world->distances[room] > world->distances[farthest])
+				farthest = room;
+		}
+		diameter = world->distances[farthest];
+
+		uint32_t distance = eccentricity(world, farthest, scratch, queue, &farthest);
+		if(distance > diameter)
+			diameter = distance;
+		header->diameterExact = 0;
+	}
+	header->diameter = diameter;
+	STATS_TIMER(TIMER_DIAMETER, start);
+
+	free(scratch);
+	free(queue);
+}
+
+/***************************************************************************************
+* Returns a connection of room that is one move closer to END, or WORLD_NO_ROOM if
+* room is END or can not reach it
+****************************************************************************************/
+uint32_t worldNextStep(const struct World *world, uint32_t room)
+{
+	uint32_t distance = world->distances[room];
+	if(distance == 0 || distance == WORLD_UNREACHABLE)
+		return WORLD_NO_ROOM;
+
+	int x;
+	for(x = 0; x < worldNumConnections(world, room); x++)
+	{
+		uint32_t other = worldConnection(world, room, x);
+		if(world->distances[other] == distance - 1)
+			return other;
+	}
+	return WORLD_NO_ROOM;
+}
+
+/***************************************************************************************
+* Reads directory name and sequence number from the manifest, false if there is none
+****************************************************************************************/
+static bool readManifest(char *directoryName, size_t size, uint64_t *sequence)
+{
+	FILE *filePointer = fopen(WORLD_MANIFEST, "r");
+	if(filePointer == NULL)
+		return false;
+
+	char lineIn[300];
+	char nameIn[256];
+	bool haveSequence = false, haveDirectory = false;
+	while(fgets(lineIn, sizeof(lineIn), filePointer))
+	{
+		if(sscanf(lineIn, "SEQUENCE: %" SCNu64, sequence) == 1)
+			haveSequence = true;
+		else if(sscanf(lineIn, "DIRECTORY: %255s", nameIn) == 1 && strlen(nameIn) < size)
+		{
+			strcpy(directoryName, nameIn);
+			haveDirectory = true;
+		}
+	}
+	fclose(filePointer);
+	return haveSequence && haveDirectory;
+}
+
+/***************************************************************************************
+* Makes directoryName the newest world. The manifest is written to a temporary file
+* and renamed over the old one, so readers see either the old or new manifest whole.
+* Sequence numbers only go up, even for worlds built in the same second.
+****************************************************************************************/
+bool worldPublish(const char *directoryName, uint64_t *sequence)
+{
+	uint64_t start = STATS_NOW();
+
+	// Lock so two builders can not hand out the same sequence number
+	int lockFd = open(WORLD_MANIFEST_LOCK, O_RDWR | O_CREAT, 0644);
+	if(lockFd < 0 || flock(lockFd, LOCK_EX) < 0)
+	{
+		perror(WORLD_MANIFEST_LOCK);
+		if(lockFd >= 0)
+			close(lockFd);
+		return false;
+	}
+
+	char oldName[256];
+	uint64_t lastSequence = 0;
+	if(!readManifest(oldName, sizeof(oldName), &lastSequence))
+		lastSequence = 0;
+	*sequence = lastSequence + 1;
+
+	char tempName[64];
+	sprintf(tempName, "%s.tmp.%d", WORLD_MANIFEST, (int)getpid());
+	FILE *filePointer = fopen(tempName, "w");
+	bool published = filePointer != NULL;
+	if(published)
+	{
+		fprintf(filePointer, "SEQUENCE: %" PRIu64 "\n", *sequence);
+		fprintf(filePointer, "DIRECTORY: %s\n", directoryName);
+		published = fclose(filePointer) == 0 && rename(tempName, WORLD_MANIFEST) == 0;
+	}
+	if(!published)
+	{
+		perror(WORLD_MANIFEST);
+		unlink(tempName);
+	}
+
+	close(lockFd);	// Also releases the lock
+	STATS_TIMER(TIMER_PUBLISH, start);
+	return published;
+}
+
+/***************************************************************************************
+* Finds newest world through the manifest in O(1), false if there is no manifest or
+* the directory it names is gone
+****************************************************************************************/
+bool worldLatest(char *directoryName, size_t size, uint64_t *sequence)
+{
+	struct stat dirAttributes;
+	if(!readManifest(directoryName, size, sequence))
+		return false;
+	return stat(directoryName, &dirAttributes) == 0 && S_ISDIR(dirAttributes.st_mode);
+}
+
+/***************************************************************************************
+* Opens world file to be read a room at a time, holding at most capacity rooms. Only
+* the header is read, so this takes the same time for any number of rooms.
+****************************************************************************************/
+bool worldCacheOpen(struct WorldCache *cache, const char *fileName, uint32_t capacity)
+{
+	uint64_t start = STATS_NOW();
+	memset(cache, 0, sizeof(struct WorldCache));
+	if(capacity < WORLD_CACHE_MIN_ROOMS)
+		capacity = WORLD_CACHE_MIN_ROOMS;
+
+	cache->fd = open(fileName, O_RDONLY);
+	if(cache->fd < 0)
+	{
+		perror(fileName);
+		return false;
+	}
+	struct stat fileAttributes;
+	if(fstat(cache->fd, &fileAttributes) < 0)
+	{
+		perror(fileName);
+		worldCacheClose(cache);
+		return false;
+	}
+	// A short read leaves the header zeroed, which checkHeader turns down
+	if(pread(cache->fd, &cache->header, sizeof(struct WorldHeader), 0) < 0)
+	{
+		perror(fileName);
+		worldCacheClose(cache);
+		return false;
+	}
+	if(!checkHeader(&cache->header, fileAttributes.st_size))
+	{
+		worldCacheClose(cache);
+		return false;
+	}
+
+	// Never hold more rooms than there are
+	if(capacity > cache->header.numRooms)
+		capacity = cache->header.numRooms;
+	cache->capacity = capacity;
+	cache->indexBits = 1;
+	while((1u << cache->indexBits) < 2 * (uint64_t)capacity)
+		cache->indexBits++;
+
+	cache->slots = malloc(sizeof(struct CachedRoom) * capacity);
+	cache->referenced = calloc(capacity, sizeof(bool));
+	cache->index = malloc(sizeof(uint32_t) << cache->indexBits);
+	if(cache->slots == NULL || cache->referenced == NULL || cache->index == NULL)
+	{
+		perror("malloc");
+		worldCacheClose(cache);
+		return false;
+	}
+	memset(cache->index, 0xFF, sizeof(uint32_t) << cache->indexBits);
+	STATS_TIMER(TIMER_OPEN_WORLD, start);
+	return true;
+}
+
+/***************************************************************************************
+* Reads size bytes at offset, false if the file ends first
+****************************************************************************************/
+static bool readSection(int fd, void *buffer, size_t size, uint64_t offset)
+{
+	ssize_t bytesRead = pread(fd, buffer, size, offset);
+	if(bytesRead < 0)
+	{
+		perror("pread");
+		return false;
+	}
+	if((size_t)bytesRead != size)
+	{
+		fprintf(stderr, "World file is truncated or corrupt\n");
+		return false;
+	}
+	return true;
+}
+
+/***************************************************************************************
+* Reads room from the world file. Everything read is checked against the header, so a
+* damaged file can only make this fail.
+****************************************************************************************/
+static bool readCachedRoom(const struct WorldCache *cache, uint32_t room, struct CachedRoom *cached)
+{
+	const struct WorldHeader *header = &cache->header;
+	uint32_t offsets[2], nameOffset;
+
+	if(!readSection(cache->fd, offsets, sizeof(offsets), header->offsetsOffset + (uint64_t)room * sizeof(uint32_t)) ||
+	   !readSection(cache->fd, &nameOffset, sizeof(uint32_t), header->namesOffset + (uint64_t)room * sizeof(uint32_t)) ||
+	   !readSection(cache->fd, &cached->distance, sizeof(uint32_t),
+	                header->distancesOffset + (uint64_t)room * sizeof(uint32_t)))
+		return false;
+	if(offsets[0] > offsets[1] || offsets[1] > header->numConnections ||
+	   offsets[1] - offsets[0] > WORLD_MAX_CONNECTIONS || nameOffset >= header->stringPoolSize)
+	{
+		fprintf(stderr, "World file room %u is corrupt\n", room);
+		return false;
+	}
+
+	cached->room = room;
+	cached->numConnections = offsets[1] - offsets[0];
+	if(!readSection(cache->fd, cached->connections, cached->numConnections * sizeof(uint32_t),
+	                header->targetsOffset + (uint64_t)offsets[0] * sizeof(uint32_t)))
+		return false;
+	uint32_t i;
+	for(i = 0; i < cached->numConnections; i++)
+	{
+		if(cached->connections[i] >= header->numRooms)
+		{
+			fprintf(stderr, "World file room %u is corrupt\n", room);
+			return false;
+		}
+	}
+
+	// Pool is terminated at its end, so only names too long for the slot can fail
+	uint32_t nameSize = header->stringPoolSize - nameOffset;
+	if(nameSize > WORLD_NAME_SIZE)
+		nameSize = WORLD_NAME_SIZE;
+	if(!readSection(cache->fd, cached->name, nameSize, header->stringPoolOffset + nameOffset))
+		return false;
+	if(memchr(cached->name, '\0', nameSize) == NULL)
+	{
+		fprintf(stderr, "World file room %u has a name longer than %d\n", room, WORLD_NAME_SIZE - 1);
+		return false;
+	}
+	return true;
+}
+
+/***************************************************************************************
+* Returns first index entry to probe for room
+****************************************************************************************/
+static uint32_t cacheHash(const struct WorldCache *cache, uint32_t room)
+{
+	return (room * 2654435769u) >> (32 - cache->indexBits);
+}
+
+/***************************************************************************************
+* Removes room held in slot from the index, moving later entries of its probe run
+* back so lookups never stop early at the hole
+****************************************************************************************/
+static void cacheRemove(struct WorldCache *cache, uint32_t slot)
+{
+	uint32_t mask = (1u << cache->indexBits) - 1;
+	uint32_t hole = cacheHash(cache, cache->slots[slot].room);
+	while(cache->index[hole] != slot)
+		hole = (hole + 1) & mask;
+
+	uint32_t next = hole;
+	for(;;)
+	{
+		next = (next + 1) & mask;
+		if(cache->index[next] == WORLD_NO_ROOM)
+			break;
+		// Entry can fill the hole if its home is not between the hole and where it is
+		uint32_t home = cacheHash(cache, cache->slots[cache->index[next]].room);
+		if(((next - home) & mask) >= ((next - hole) & mask))
+		{
+			cache->index[hole] = cache->index[next];
+			hole = next;
+		}
+	}
+	cache->index[hole] = WORLD_NO_ROOM;
+}
+
+/***************************************************************************************
+* Copies room into cached, reading it from the file if it is not held. False if room
+* does not exist or could not be read.
+****************************************************************************************/
+bool worldCacheRoom(struct WorldCache *cache, uint32_t room, struct CachedRoom *cached)
+{
+	if(room >= cache->header.numRooms)
+		return false;
+
+	uint32_t mask = (1u << cache->indexBits) - 1;
+	uint32_t probe = cacheHash(cache, room);
+	while(cache->index[probe] != WORLD_NO_ROOM)
+	{
+		uint32_t slot = cache->index[probe];
+		if(cache->slots[slot].room == room)
+		{
+			cache->referenced[slot] = true;
+			*cached = cache->slots[slot];
+			return true;
+		}
+		probe = (probe + 1) & mask;
+	}
+
+	// Read first, so a failed read leaves every held room in place
+	if(!readCachedRoom(cache, room, cached))
+		return false;
+	STATS_COUNT(COUNTER_ROOMS_READ, 1);
+
+	uint32_t slot;
+	if(cache->used < cache->capacity)
+		slot = cache->used++;
+	else
+	{
+		// Touched rooms get one more pass of the hand before they can go
+		while(cache->referenced[cache->hand])
+		{
+			cache->referenced[cache->hand] = false;
+			cache->hand = (cache->hand + 1) % cache->capacity;
+		}
+		slot = cache->hand;
+		cache->hand = (cache->hand + 1) % cache->capacity;
+		cacheRemove(cache, slot);
+		STATS_COUNT(COUNTER_ROOMS_EVICTED, 1);
+
+		// Removing may have moved entries into the probe run of room
+		probe = cacheHash(cache, room);
+		while(cache->index[probe] != WORLD_NO_ROOM)
+			probe = (probe + 1) & mask;
+	}
+
+	cache->slots[slot] = *cached;
+	cache->referenced[slot] = true;
+	cache->index[probe] = slot;
+	return true;
+}
+
+/***************************************************************************************
+* Closes world file and frees every held room
+****************************************************************************************/
+void worldCacheClose(struct WorldCache *cache)
+{
+	if(cache->fd >= 0)
+		close(cache->fd);
+	free(cache->slots);
+	free(cache->referenced);
+	free(cache->index);
+	memset(cache, 0, sizeof(struct WorldCache));
+	cache->fd = -1;
+}
+
+/***************************************************************************************
+* Returns letter in lower case. ASCII only, which is all room names use, and cheaper
+* than tolower.
+****************************************************************************************/
+static char foldLetter(char letter)
+{
+	return letter >= 'A' && letter <= 'Z' ? letter + ('a' - 'A') : letter;
+}
+
+/***************************************************************************************
+* Orders two FoldedNames by name with letters folded to lower case
+****************************************************************************************/
+static int compareFolded(const void *a, const void *b)
+{
+	const char *x = ((const struct FoldedName*)a)->name;
+	const char *y = ((const struct FoldedName*)b)->name;
+	while(*x != '\0' && foldLetter(*x) == foldLetter(*y))
+	{
+		x++;
+		y++;
+	}
+	return (unsigned char)foldLetter(*x) - (unsigned char)foldLetter(*y);
+}
+
+/***************************************************************************************
+* Builds the name trie of world. Names are sorted once, then each name only adds the
+* nodes past the part it shares with the name before it, so every node's rooms have
+* consecutive ranks. No more nodes than bytes of names are ever needed.
+****************************************************************************************/
+bool worldMatcherBuild(struct WorldMatcher *matcher, const struct World *world)
+{
+	uint32_t numRooms = world->header->numRooms;
+	memset(matcher, 0, sizeof(struct WorldMatcher));
+	struct FoldedName *sorted = malloc((size_t)numRooms * sizeof(struct FoldedName));
+	matcher->nodes = malloc(((size_t)world->header->stringPoolSize + 1) * sizeof(struct MatchNode));
+	matcher->ranks = malloc((size_t)numRooms * sizeof(uint32_t));
+	size_t longest = 0;
+	uint32_t room;
+	for(room = 0; sorted != NULL && room < numRooms; room++)
+	{
+		sorted[room].name = worldRoomName(world, room);
+		sorted[room].room = room;
+		size_t length = strlen(sorted[room].name);
+		if(length > longest)
+			longest = length;
+	}
+	// Nodes of the previous name, one per letter
+	uint32_t *path = malloc((longest + 1) * sizeof(uint32_t));
+	if(sorted == NULL || matcher->nodes == NULL || matcher->ranks == NULL || path == NULL)
+	{
+		perror("malloc");
+		free(sorted);
+		free(path);
+		worldMatcherFree(matcher);
+		return false;
+	}
+	qsort(sorted, numRooms, sizeof(struct FoldedName), compareFolded);
+
+	struct MatchNode *nodes = matcher->nodes;
+	nodes[0] = (struct MatchNode){ WORLD_NO_ROOM, WORLD_NO_ROOM, 0, numRooms, '\0' };
+	matcher->numNodes = 1;
+	uint32_t pathLength = 0;
+	uint32_t rank;
+	for(rank = 0; rank < numRooms; rank++)
+	{
+		matcher->ranks[sorted[rank].room] = rank;
+		const char *name = sorted[rank].name;
+		uint32_t node = 0, depth;
+		bool shared = true;	// Still on the previous name's nodes
+		for(depth = 0; name[depth] != '\0'; depth++)
+		{
+			char letter = foldLetter(name[depth]);
+			uint32_t next;
+			if(shared && depth < pathLength && nodes[path[depth]].letter == letter)
+				next = path[depth];
+			else
+			{
+				// Names are sorted, so a new node always comes after its siblings
+				next = matcher->numNodes++;
+				nodes[next] = (struct MatchNode){ WORLD_NO_ROOM, WORLD_NO_ROOM, rank, rank, letter };
+				if(shared && depth < pathLength)
+					nodes[path[depth]].sibling = next;
+				else
+					nodes[node].child = next;
+				shared = false;
+			}
+			nodes[next].last = rank + 1;
+			path[depth] = next;
+			node = next;
+		}
+		pathLength = depth;
+	}
+	free(sorted);
+	free(path);
+	return true;
+}
+
+/***************************************************************************************
+* Finds the connections of room whose names start with prefix, ignoring case. Up to
+* maxMatches of them are put in matches, in the order room lists them, and the number
+* found is returned. Walks one node per letter of prefix, then checks each connection's
+* rank, so the size of the world does not matter.
+****************************************************************************************/
+int worldMatchConnections(const struct WorldMatcher *matcher, const struct World *world, uint32_t room,
+                          const char *prefix, uint32_t *matches, int maxMatches)
+{
+	uint32_t node = 0;
+	const char *next;
+	for(next = prefix; *next != '\0' && node != WORLD_NO_ROOM; next++)
+	{
+		char letter = foldLetter(*next);
+		node = matcher->nodes[node].child;
+		while(node != WORLD_NO_ROOM && (unsigned char)matcher->nodes[node].letter < (unsigned char)letter)
+			node = matcher->nodes[node].sibling;
+		if(node != WORLD_NO_ROOM && matcher->nodes[node].letter != letter)
+			node = WORLD_NO_ROOM;
+	}
+	if(node == WORLD_NO_ROOM)
+		return 0;
+
+	const struct MatchNode *found = &matcher->nodes[node];
+	int numMatches = 0;
+	uint32_t i;
+	for(i = world->offsets[room]; i < world->offsets[room + 1]; i++)
+	{
+		uint32_t rank = matcher->ranks[world->targets[i]];
+		if(rank >= found->first && rank < found->last)
+		{
+			if(numMatches < maxMatches)
+				matches[numMatches] = world->targets[i];
+			numMatches++;
+		}
+	}
+	return numMatches;
+}
+
+/***************************************************************************************
+* Frees the trie and ranks, safe on a matcher that was never built
+****************************************************************************************/
+void worldMatcherFree(struct WorldMatcher *matcher)
+{
+	free(matcher->nodes);
+	free(matcher->ranks);
+	memset(matcher, 0, sizeof(struct WorldMatcher));
+}
+
+/***************************************************************************************
+* Writes value as a little endian base 128 varint to out, returns bytes written
+****************************************************************************************/
+static size_t putVarint(uint8_t *out, uint64_t value)
+{
+	size_t length = 0;
+	while(value >= 0x80)
+	{
+		out[length++] = (uint8_t)value | 0x80;
+		value >>= 7;
+	}
+	out[length++] = (uint8_t)value;
+	return length;
+}
+
+/***************************************************************************************
+* Reads a varint from *next, which is moved past it. False if it runs past end.
+****************************************************************************************/
+static bool getVarint(const uint8_t **next, const uint8_t *end, uint64_t *value)
+{
+	const uint8_t *byte = *next;
+	int shift;
+	*value = 0;
+	for(shift = 0; byte < end && shift < 64; shift += 7)
+	{
+		*value |= (uint64_t)(*byte & 0x7F) << shift;
+		if((*byte++ & 0x80) == 0)
+		{
+			*next = byte;
+			return true;
+		}
+	}
+	return false;
+}
+
+/***************************************************************************************
+* Splits name into a stem and a number of up to 9 digits with no leading zero, so
+* R123 is R and 123. Returns length of the stem, which is all of name if there is
+* no number.
+****************************************************************************************/
+static size_t splitName(const char *name, uint32_t *number)
+{
+	size_t length = strlen(name), stemLength = length;
+	while(stemLength > 0 && isdigit((unsigned char)name[stemLength - 1]))
+		stemLength--;
+	size_t digits = length - stemLength;
+	if(digits == 0 || digits > 9 || (name[stemLength] == '0' && digits > 1))
+		return length;
+	*number = strtoul(name + stemLength, NULL, 10);
+	return stemLength;
+}
+
+/***************************************************************************************
+* Returns dictionary number of the first length characters of stem, adding them if
+* they are new. -1 if they do not fit in the dictionary.
+****************************************************************************************/
+static int archiveStem(struct ArchiveHeader *archive, const char *stem, size_t length)
+{
+	uint32_t x;
+	if(length >= WORLD_ARCHIVE_STEM_SIZE)
+		return -1;
+	for(x = 0; x < archive->numStems; x++)
+	{
+		if(strncmp(archive->stems[x], stem, length) == 0 && archive->stems[x][length] == '\0')
+			return x;
+	}
+	if(archive->numStems == WORLD_ARCHIVE_STEMS)
+		return -1;
+	memset(archive->stems[x], '\0', WORLD_ARCHIVE_STEM_SIZE);
+	memcpy(archive->stems[x], stem, length);
+	archive->numStems++;
+	return x;
+}
+
+/***************************************************************************************
+* Checks an archive header read from fileName, and that every stem is terminated
+****************************************************************************************/
+static bool checkArchiveHeader(const struct ArchiveHeader *archive, const char *fileName)
+{
+	uint32_t x;
+	if(memcmp(archive->magic, WORLD_ARCHIVE_MAGIC, 8) != 0 || archive->version != WORLD_ARCHIVE_VERSION)
+	{
+		fprintf(stderr, "%s is not a version %d world archive\n", fileName, WORLD_ARCHIVE_VERSION);
+		return false;
+	}
+	if(archive->numStems > WORLD_ARCHIVE_STEMS || archive->numWorlds > WORLD_ARCHIVE_WORLDS)
+	{
+		fprintf(stderr, "%s header is corrupt\n", fileName);
+		return false;
+	}
+	for(x = 0; x < archive->numStems; x++)
+	{
+		if(memchr(archive->stems[x], '\0', WORLD_ARCHIVE_STEM_SIZE) == NULL)
+		{
+			fprintf(stderr, "%s name dictionary is corrupt\n", fileName);
+			return false;
+		}
+	}
+	return true;
+}
+
+/***************************************************************************************
+* Writes size bytes at offset, false if any could not be written
+****************************************************************************************/
+static bool writeSection(int fd, const void *buffer, size_t size, uint64_t offset)
+{
+	const char *next = buffer;
+	while(size > 0)
+	{
+		ssize_t written = pwrite(fd, next, size, offset);
+		if(written < 0)
+		{
+			perror("pwrite");
+			return false;
+		}
+		next += written;
+		size -= written;
+		offset += written;
+	}
+	return true;
+}
+
+/***************************************************************************************
+* Appends world to the archive fileName, creating it if needed, and sets worldId to
+* the number it can be loaded by. seed and stream are kept in the index to say where
+* the world came from. If sync is set the world is on disk before it is counted.
+*
+* Appends are serialized with flock, so threads and processes can share an archive.
+* Record, index entry and new stems are written first and the world count last, so a
+* reader or a crash in between sees the archive as it was before.
+****************************************************************************************/
+bool worldArchiveAppend(const char *fileName, const struct World *world, uint64_t seed, uint32_t stream,
+                        bool sync, uint64_t *worldId)
+{
+	const struct WorldHeader *header = world->header;
+	uint32_t numRooms = header->numRooms, room, i;
+
+	// A varint of a 32 bit value is at most 5 bytes, so these never overflow
+	uint8_t *connections = malloc(((size_t)numRooms + header->numConnections) * 5);
+	uint8_t *names = malloc((size_t)numRooms * 10);
+	if(connections == NULL || names == NULL)
+	{
+		perror("malloc");
+		free(connections);
+		free(names);
+		return false;
+	}
+
+	// Connections do not use the dictionary, so they are encoded before taking the lock
+	size_t connectionsSize = 0;
+	for(room = 0; room < numRooms; room++)
+	{
+		uint32_t previous = room;
+		connectionsSize += putVarint(connections + connectionsSize, worldNumConnections(world, room));
+		for(i = world->offsets[room]; i < world->offsets[room + 1]; i++)
+		{
+			int64_t difference = (int64_t)world->targets[i] - previous;
+			connectionsSize += putVarint(connections + connectionsSize, (uint64_t)(difference * 2) ^ (uint64_t)(difference >> 63));
+			previous = world->targets[i];
+		}
+	}
+
+	int fd = open(fileName, O_RDWR | O_CREAT, 0644);
+	if(fd < 0 || flock(fd, LOCK_EX) < 0)
+	{
+		perror(fileName);
+		if(fd >= 0)
+			close(fd);
+		free(connections);
+		free(names);
+		return false;
+	}
+
+	// Empty file is a new archive, records start after the whole index
+	struct ArchiveHeader archive;
+	struct stat fileAttributes;
+	bool appended = fstat(fd, &fileAttributes) == 0;
+	if(appended && fileAttributes.st_size == 0)
+	{
+		memset(&archive, 0, sizeof(struct ArchiveHeader));
+		memcpy(archive.magic, WORLD_ARCHIVE_MAGIC, 8);
+		archive.version = WORLD_ARCHIVE_VERSION;
+		archive.endOffset = sizeof(struct ArchiveHeader) + (uint64_t)WORLD_ARCHIVE_WORLDS * sizeof(struct ArchiveEntry);
+		appended = writeSection(fd, &archive, sizeof(struct ArchiveHeader), 0);
+	}
+	else if(appended)
+		appended = readSection(fd, &archive, sizeof(struct ArchiveHeader), 0) && checkArchiveHeader(&archive, fileName);
+	else
+		perror(fileName);
+	if(appended && archive.numWorlds == WORLD_ARCHIVE_WORLDS)
+	{
+		fprintf(stderr, "%s already holds %d worlds, start a new archive\n", fileName, WORLD_ARCHIVE_WORLDS);
+		appended = false;
+	}
+
+	// Names go in as stem number, low bit set if a number follows
+	size_t namesSize = 0;
+	uint32_t numStems = archive.numStems;
+	for(room = 0; appended && room < numRooms; room++)
+	{
+		const char *name = worldRoomName(world, room);
+		uint32_t number = 0;
+		size_t stemLength = splitName(name, &number);
+		int stem = archiveStem(&archive, name, stemLength);
+		if(stem < 0)
+		{
+			fprintf(stderr, "%s: room name %s does not fit in the name dictionary\n", fileName, name);
+			appended = false;
+			break;
+		}
+		bool hasNumber = name[stemLength] != '\0';
+		namesSize += putVarint(names + namesSize, (uint64_t)stem * 2 + hasNumber);
+		if(hasNumber)
+		{
+			int64_t difference = (int64_t)number - room;
+			namesSize += putVarint(names + namesSize, (uint64_t)(difference * 2) ^ (uint64_t)(difference >> 63));
+		}
+	}
+
+	struct ArchiveRecord record = { numRooms, header->numConnections, header->startRoom, header->endRoom,
+		header->stringPoolSize, header->diameter, header->diameterExact, namesSize };
+	struct ArchiveEntry entry;
+	memset(&entry, 0, sizeof(struct ArchiveEntry));
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	entry.seed = seed;
+	entry.stream = stream;
+	entry.numRooms = numRooms;
+	entry.created = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+	entry.offset = archive.endOffset;
+	entry.size = sizeof(struct ArchiveRecord) + namesSize + connectionsSize;
+
+	appended = appended &&
+	           writeSection(fd, &record, sizeof(struct ArchiveRecord), entry.offset) &&
+	           writeSection(fd, names, namesSize, entry.offset + sizeof(struct ArchiveRecord)) &&
+	           writeSection(fd, connections, connectionsSize, entry.offset + sizeof(struct ArchiveRecord) + namesSize) &&
+	           writeSection(fd, &entry, sizeof(struct ArchiveEntry),
+	                        sizeof(struct ArchiveHeader) + archive.numWorlds * sizeof(struct ArchiveEntry));
+	if(appended && archive.numStems != numStems)
+		appended = writeSection(fd, &archive.stems[numStems], (archive.numStems - numStems) * WORLD_ARCHIVE_STEM_SIZE,
+		                        offsetof(struct ArchiveHeader, stems) + numStems * WORLD_ARCHIVE_STEM_SIZE);
+	if(appended && sync && fdatasync(fd) < 0)
+	{
+		perror(fileName);
+		appended = false;
+	}
+
+	// Counts fit in the first 512 bytes, so the world appears in one sector write
+	if(appended)
+	{
+		archive.numWorlds++;
+		archive.endOffset += entry.size;
+		appended = writeSection(fd, &archive, offsetof(struct ArchiveHeader, stems), 0) &&
+		           (!sync || fdatasync(fd) == 0);
+		*worldId = archive.numWorlds;
+	}
+	close(fd);	// Also releases the lock
+	free(connections);
+	free(names);
+	if(appended)
+		STATS_COUNT(COUNTER_BYTES_WRITTEN, entry.size);
+	return appended;
+}
+
+/***************************************************************************************
+* Rebuilds world from an archive record of size bytes. Every number is checked, so a
+* damaged record can only make this fail.
+****************************************************************************************/
+static bool decodeArchiveRecord(const struct ArchiveHeader *archive, const uint8_t *data, uint64_t size,
+                                struct World *world)
+{
+	struct ArchiveRecord record;
+	memcpy(&record, data, sizeof(struct ArchiveRecord));
+
+	// Every room takes at least 2 bytes and every connection 1, so sizes are checked
+	// against the record before anything is allocated
+	uint64_t encodedSize = size - sizeof(struct ArchiveRecord);
+	if(record.numRooms == 0 || record.startRoom >= record.numRooms || record.endRoom >= record.numRooms ||
+	   record.stringPoolSize == 0 || record.namesSize > encodedSize ||
+	   2 * (uint64_t)record.numRooms + record.numConnections > encodedSize ||
+	   record.stringPoolSize > (uint64_t)record.numRooms * (WORLD_ARCHIVE_STEM_SIZE + 9))
+	{
+		fprintf(stderr, "World archive record is corrupt\n");
+		return false;
+	}
+	if(!worldCreate(world, record.numRooms, record.numConnections, record.stringPoolSize))
+		return false;
+
+	// Sections are filled through writable pointers, like buildrooms does
+	struct WorldHeader *header = world->base;
+	uint32_t *offsets = (uint32_t*)world->offsets;
+	uint32_t *targets = (uint32_t*)world->targets;
+	uint32_t *names = (uint32_t*)world->names;
+	char *strings = (char*)world->strings;
+	header->startRoom = record.startRoom;
+	header->endRoom = record.endRoom;
+
+	const uint8_t *next = data + sizeof(struct ArchiveRecord);
+	const uint8_t *end = next + record.namesSize;
+	uint32_t numRooms = record.numRooms, nextString = 0, room;
+	bool valid = true;
+	for(room = 0; valid && room < numRooms; room++)
+	{
+		uint64_t code, difference = 0;
+		valid = getVarint(&next, end, &code) && code / 2 < archive->numStems &&
+		        ((code & 1) == 0 || getVarint(&next, end, &difference));
+		if(!valid)
+			break;
+
+		// Stem is at most 15 characters and the number at most 9 digits
+		char name[WORLD_ARCHIVE_STEM_SIZE + 10];
+		int64_t number = room + ((int64_t)(difference >> 1) ^ -(int64_t)(difference & 1));
+		int length;
+		if(code & 1)
+		{
+			valid = number >= 0 && number <= 999999999;
+			length = snprintf(name, sizeof(name), "%s%" PRId64, archive->stems[code / 2], number);
+		}
+		else
+			length = snprintf(name, sizeof(name), "%s", archive->stems[code / 2]);
+		valid = valid && (uint64_t)nextString + length + 1 <= record.stringPoolSize;
+		if(valid)
+		{
+			names[room] = nextString;
+			memcpy(strings + nextString, name, length + 1);
+			nextString += length + 1;
+		}
+	}
+	valid = valid && next == end && nextString == record.stringPoolSize;
+
+	end = data + size;
+	uint32_t numTargets = 0;
+	for(room = 0; valid && room < numRooms; room++)
+	{
+		uint64_t degree, difference;
+		int64_t previous = room;
+		valid = getVarint(&next, end, &degree) && degree <= record.numConnections - numTargets;
+		offsets[room] = numTargets;
+		while(valid && degree-- > 0)
+		{
+			valid = getVarint(&next, end, &difference);
+			previous += (int64_t)(difference >> 1) ^ -(int64_t)(difference & 1);
+			valid = valid && previous >= 0 && previous < numRooms;
+			if(valid)
+				targets[numTargets++] = previous;
+		}
+	}
+	offsets[numRooms] = numTargets;
+	valid = valid && numTargets == record.numConnections && next == end;
+
+	if(!valid || !worldBuildIndex(world))
+	{
+		if(!valid)
+			fprintf(stderr, "World archive record is corrupt\n");
+		worldClose(world);
+		return false;
+	}
+	worldComputeDistances(world, 1);
+	header->diameter = record.diameter;
+	header->diameterExact = record.diameterExact;
+	return true;
+}
+
+/***************************************************************************************
+* Loads world number *worldId, or the newest world for WORLD_ARCHIVE_LATEST, from the
+* archive fileName into memory and sets *worldId to the number loaded. Reads the
+* header, one index entry and one record, so this takes the same time however many
+* worlds the archive holds.
+****************************************************************************************/
+bool worldArchiveLoad(const char *fileName, uint64_t *loadWorldId, struct World *world)
+{
+	uint64_t worldId = *loadWorldId;
+	uint64_t start = STATS_NOW();
+	int fd = open(fileName, O_RDONLY);
+	if(fd < 0)
+	{
+		perror(fileName);
+		return false;
+	}
+
+	// Shared lock so an append is never seen half done
+	struct ArchiveHeader archive;
+	struct ArchiveEntry entry;
+	bool found = flock(fd, LOCK_SH) == 0;
+	if(!found)
+		perror(fileName);
+	found = found && readSection(fd, &archive, sizeof(struct ArchiveHeader), 0) &&
+	        checkArchiveHeader(&archive, fileName);
+	if(found && worldId == WORLD_ARCHIVE_LATEST)
+		worldId = archive.numWorlds;
+	if(found && (worldId == 0 || worldId > archive.numWorlds))
+	{
+		fprintf(stderr, "%s has no world %" PRIu64 ", it holds %" PRIu64 "\n", fileName, worldId, archive.numWorlds);
+		found = false;
+	}
+	found = found && readSection(fd, &entry, sizeof(struct ArchiveEntry),
+	                             sizeof(struct ArchiveHeader) + (worldId - 1) * sizeof(struct ArchiveEntry));
+	flock(fd, LOCK_UN);
+
+	// Counted records are never written again, so this needs no lock
+	uint8_t *data = NULL;
+	struct stat fileAttributes;
+	found = found && fstat(fd, &fileAttributes) == 0;
+	if(found && (entry.size < sizeof(struct ArchiveRecord) || entry.offset + entry.size > archive.endOffset ||
+	             entry.offset + entry.size < entry.offset || entry.offset + entry.size > (uint64_t)fileAttributes.st_size))
+	{
+		fprintf(stderr, "%s index entry %" PRIu64 " is corrupt\n", fileName, worldId);
+		found = false;
+	}
+	if(found && (data = malloc(entry.size)) == NULL)
+	{
+		perror("malloc");
+		found = false;
+	}
+	found = found && readSection(fd, data, entry.size, entry.offset);
+	close(fd);
+
+	found = found && decodeArchiveRecord(&archive, data, entry.size, world);
+	free(data);
+	if(found)
+	{
+		*loadWorldId = worldId;
+		STATS_TIMER(TIMER_OPEN_WORLD, start);
+	}
+	return found;
+}
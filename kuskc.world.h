@@ -0,0 +1,264 @@
+/********************************************************************************
+  Binary world file shared by buildrooms and adventure. A world is one file laid
+  out as header, connection offsets, connection targets, name offsets, name index,
+  distances, string pool, with every section 8-byte aligned so adventure can mmap the file
+  and use it without copying.
+
+  Rooms are numbered 0 to numRooms - 1. Connections are stored in compressed
+  sparse row form: the rooms connected to room r are
+  targets[offsets[r]] through targets[offsets[r + 1] - 1].
+
+  The name index is an open addressed hash table of room numbers, at least twice
+  as large as the number of rooms, so finding a room by name is O(1).
+
+  distances[r] is the fewest moves from room r to the END room, worked out once
+  when the world is built so every game can compare against it and give hints.
+
+  A WorldCache reads the same file a room at a time instead of mapping it. The
+  offsets and names sections say where each room's connections and name are, so
+  a room is a handful of small reads and only rooms that were reached are held.
+
+  worldSaveSource writes the sections as static const C arrays instead, so a
+  world can be compiled into a program and played without opening any file.
+
+  A world archive holds many worlds in one append-only file: a header with the
+  shared name dictionary, a fixed index of WORLD_ARCHIVE_WORLDS entries, then one
+  record per world. World n is index entry n - 1, so any world is found with one
+  read. A record stores only the connections and names as varints. Connections
+  are kept in order, each as the zigzag difference from the previous one. A name
+  is a dictionary stem plus an optional number, stored as the difference from
+  the room number, so R0 to R9999999 cost 2 bytes a room. Index, distances and
+  strings are rebuilt when the world is loaded.
+
+  A WorldMatcher is a trie of room names with letters folded to lower case, built
+  in memory when a world is first asked for a name that is not exact. Rooms are
+  ranked by folded name and each trie node holds the range of ranks below it, so
+  the connections starting with what a player typed are found in time set by the
+  length of the input, whatever the size of the world.
+*********************************************************************************/
+
+#ifndef KUSKC_WORLD_H
+#define KUSKC_WORLD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define WORLD_MAGIC "KUSKCWLD"      // First 8 bytes of every world file
+#define WORLD_VERSION 4             // Bumped whenever the layout changes
+#define WORLD_FILE_NAME "world.bin" // Name of world file inside a rooms directory
+#define WORLD_SOURCE_NAME "world.h" // Name of world compiled as C, see worldSaveSource
+#define WORLD_NO_ROOM UINT32_MAX    // Empty name index slot, or name not found
+#define WORLD_UNREACHABLE UINT32_MAX // Distance of a room with no path to END
+#define WORLD_MANIFEST "kuskc.latest"            // Names newest rooms directory
+#define WORLD_MANIFEST_LOCK "kuskc.latest.lock"  // Serializes manifest updates
+#define WORLD_CACHE_ROOMS 4096      // Default rooms a WorldCache keeps
+#define WORLD_CACHE_MIN_ROOMS 8     // A room and all its connections always fit
+#define WORLD_MAX_CONNECTIONS 6     // Most connections a cached room can have
+#define WORLD_NAME_SIZE 16          // Longest cached room name, with terminator
+#define WORLD_ARCHIVE_MAGIC "KUSKCARC"   // First 8 bytes of every world archive
+#define WORLD_ARCHIVE_VERSION 1
+#define WORLD_ARCHIVE_NAME "kuskc.worlds" // Archive buildrooms -f archive appends to
+#define WORLD_ARCHIVE_WORLDS 1048576 // Index entries, most worlds one archive holds
+#define WORLD_ARCHIVE_STEMS 256     // Name stems in the shared dictionary
+#define WORLD_ARCHIVE_STEM_SIZE 16  // Longest stem, with terminator
+#define WORLD_ARCHIVE_LATEST 0      // World number that means the newest world
+
+// Room types, a world has exactly one START_ROOM and one END_ROOM
+enum RoomType
+{
+	START_ROOM,
+	MID_ROOM,
+	END_ROOM
+};
+
+// Fixed size header at offset 0
+struct WorldHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t numRooms;
+	uint32_t numConnections;    // Entries in targets, each connection is stored in both rooms
+	uint32_t startRoom;
+	uint32_t endRoom;
+	uint32_t stringPoolSize;    // Bytes of null terminated names
+	uint32_t indexSize;         // Slots in name index, a power of two
+	uint32_t unreachableRooms;  // Rooms with no path to END
+	uint32_t diameter;          // Longest shortest path between any two rooms, 0 if not computed
+	uint32_t diameterExact;     // 0 if diameter is a lower bound from two sweeps
+	uint64_t offsetsOffset;     // numRooms + 1 entries
+	uint64_t targetsOffset;     // numConnections entries
+	uint64_t namesOffset;       // numRooms entries
+	uint64_t indexOffset;       // indexSize entries
+	uint64_t distancesOffset;   // numRooms entries
+	uint64_t stringPoolOffset;
+	uint64_t fileSize;
+};
+
+// Fixed size header at offset 0 of a world archive, the index follows it
+struct ArchiveHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t numStems;
+	uint64_t numWorlds;         // Worlds 1 to numWorlds are complete, a world counts once this says so
+	uint64_t endOffset;         // Where the next record goes
+	char stems[WORLD_ARCHIVE_STEMS][WORLD_ARCHIVE_STEM_SIZE];
+};
+
+// Index entry of one archived world
+struct ArchiveEntry
+{
+	uint64_t seed;              // Master seed and stream buildrooms built it from
+	uint32_t stream;
+	uint32_t numRooms;
+	uint64_t created;           // Nanoseconds since the epoch
+	uint64_t offset;            // Record position in the archive
+	uint64_t size;              // Record bytes
+};
+
+// Start of an archive record, names then connections follow as varints
+struct ArchiveRecord
+{
+	uint32_t numRooms;
+	uint32_t numConnections;
+	uint32_t startRoom;
+	uint32_t endRoom;
+	uint32_t stringPoolSize;
+	uint32_t diameter;          // Copied from the world header, it is too slow to redo
+	uint32_t diameterExact;
+	uint32_t namesSize;         // Bytes of encoded names
+};
+
+// View of a world, either mapped from a file or built in memory
+struct World
+{
+	const struct WorldHeader *header;
+	const uint32_t *offsets;      // Index into targets of each room's first connection
+	const uint32_t *targets;      // Room numbers of connected rooms
+	const uint32_t *names;        // Offset of each room's name in string pool
+	const uint32_t *index;        // Room numbers hashed by name
+	const uint32_t *distances;    // Moves from each room to END
+	const char *strings;
+	void *base;                   // Start of the whole image
+	size_t size;                  // Size of the whole image
+	bool mapped;                  // True if base came from mmap, false if malloc
+};
+
+// One room read from a world file by worldCacheRoom
+struct CachedRoom
+{
+	uint32_t room;
+	uint32_t distance;                        // Moves to END
+	uint32_t numConnections;
+	uint32_t connections[WORLD_MAX_CONNECTIONS];
+	char name[WORLD_NAME_SIZE];
+};
+
+// World file read a room at a time. Holds at most capacity rooms, when full the room
+// not touched for longest is dropped, found with a clock hand over the slots.
+struct WorldCache
+{
+	int fd;
+	struct WorldHeader header;
+	struct CachedRoom *slots;
+	bool *referenced;             // Slot was touched since the hand last passed it
+	uint32_t *index;              // Slot of each held room hashed by room number
+	uint32_t indexBits;           // Index has 2^indexBits entries, at least 2 * capacity
+	uint32_t capacity, used, hand;
+};
+
+// One letter of a WorldMatcher. Siblings are in letter order.
+struct MatchNode
+{
+	uint32_t child;               // First node one letter longer, WORLD_NO_ROOM if none
+	uint32_t sibling;             // Next node with the same parent, WORLD_NO_ROOM if none
+	uint32_t first, last;         // Ranks of the rooms whose names start here, last is one past
+	char letter;                  // Folded to lower case
+};
+
+// Room names of a world for prefix and case insensitive matching
+struct WorldMatcher
+{
+	struct MatchNode *nodes;      // nodes[0] is the empty prefix
+	uint32_t *ranks;              // Position of each room in folded name order
+	uint32_t numNodes;
+};
+
+// Function Declarations
+bool worldCreate(struct World*, uint32_t, uint32_t, uint32_t);
+bool worldOpen(struct World*, const char*);
+bool worldCheck(const struct World*);
+bool worldSave(const struct World*, const char*, bool);
+bool worldSaveSource(const struct World*, const char*, bool);
+void worldClose(struct World*);
+bool worldBuildIndex(struct World*);
+uint32_t worldFindRoom(const struct World*, const char*);
+void worldComputeDistances(struct World*, int);
+void worldComputeDiameter(struct World*);
+uint32_t worldNextStep(const struct World*, uint32_t);
+bool worldPublish(const char*, uint64_t*);
+bool worldLatest(char*, size_t, uint64_t*);
+const char *roomTypeName(enum RoomType);
+bool worldCacheOpen(struct WorldCache*, const char*, uint32_t);
+bool worldCacheRoom(struct WorldCache*, uint32_t, struct CachedRoom*);
+void worldCacheClose(struct WorldCache*);
+bool worldMatcherBuild(struct WorldMatcher*, const struct World*);
+int worldMatchConnections(const struct WorldMatcher*, const struct World*, uint32_t, const char*, uint32_t*, int);
+void worldMatcherFree(struct WorldMatcher*);
+bool worldArchiveAppend(const char*, const struct World*, uint64_t, uint32_t, bool, uint64_t*);
+bool worldArchiveLoad(const char*, uint64_t*, struct World*);
+
+/***************************************************************************************
+* Returns name of room
+****************************************************************************************/
+static inline const char *worldRoomName(const struct World *world, uint32_t room)
+{
+	return world->strings + world->names[room];
+}
+
+/***************************************************************************************
+* Returns type of room, only the START and END rooms are recorded
+****************************************************************************************/
+static inline enum RoomType worldRoomType(const struct World *world, uint32_t room)
+{
+	if(room == world->header->endRoom)
+		return END_ROOM;
+	if(room == world->header->startRoom)
+		return START_ROOM;
+	return MID_ROOM;
+}
+
+/***************************************************************************************
+* Returns number of connections of room
+****************************************************************************************/
+static inline int worldNumConnections(const struct World *world, uint32_t room)
+{
+	return world->offsets[room + 1] - world->offsets[room];
+}
+
+/***************************************************************************************
+* Returns room number of the i-th connection of room
+****************************************************************************************/
+static inline uint32_t worldConnection(const struct World *world, uint32_t room, int i)
+{
+	return world->targets[world->offsets[room] + i];
+}
+
+/***************************************************************************************
+* Returns room number of the connection of room called name, or WORLD_NO_ROOM if name
+* is not one of room's connections. One index lookup, then integer compares.
+****************************************************************************************/
+static inline uint32_t worldMoveTarget(const struct World *world, uint32_t room, const char *name)
+{
+	uint32_t nextRoom = worldFindRoom(world, name);
+	uint32_t i;
+	for(i = world->offsets[room]; i < world->offsets[room + 1] && nextRoom != WORLD_NO_ROOM; i++)
+	{
+		if(world->targets[i] == nextRoom)
+			return nextRoom;
+	}
+	return WORLD_NO_ROOM;
+}
+
+#endif